@@ -32,8 +32,48 @@
  *	All others will be ignored.
 */
 
+#include <avr/sleep.h>
+
 #include "TVout.h"
 
+// 0x80 >> n, a shift by a variable is a loop on the avr.
+const uint8_t pixel_mask[8] = {0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01};
+// pixels n to 7 and 0 to n of a byte, the two ends of a span.
+static const uint8_t left_mask[8] = {0xff, 0x7f, 0x3f, 0x1f, 0x0f, 0x07, 0x03, 0x01};
+static const uint8_t right_mask[8] = {0x80, 0xc0, 0xe0, 0xf0, 0xf8, 0xfc, 0xfe, 0xff};
+
+// an edge of a polygon stepped a row at a time, see edge_start()
+typedef struct {
+	int x;
+	int rows;		//rows left before the next edge
+	int q;			//whole pixels per row
+	int r;			//and the remainder, abs(dx % dy)
+	int dy;
+	int e;
+	int s;			//1 or -1, sign of dx
+} poly_edge;
+
+static void edge_start(poly_edge * e, const int * a, const int * b);
+static void inline edge_step(poly_edge * e);
+static void edge_skip(poly_edge * e, int k);
+
+static void inline sp(unsigned char x, unsigned char y, char c);
+static void inline __attribute__((always_inline)) put(uint8_t * p, uint8_t mask, char c);
+static void inline __attribute__((always_inline)) line_walk(uint8_t * p, uint8_t x, uint8_t dx, uint8_t dy, int step, char c);
+static void inline __attribute__((always_inline)) span(uint8_t * p, uint8_t x0, uint8_t x1, char c);
+static void inline __attribute__((always_inline)) rop_byte(uint8_t * p, uint8_t v, uint8_t mask, uint8_t rop);
+static void inline __attribute__((always_inline)) blit_row(uint8_t * p, const uint8_t * s, uint8_t n, uint8_t lmask, uint8_t rmask, uint8_t rop);
+static inline uint8_t * row_addr(uint8_t y);
+static inline uint8_t row_of(uint8_t y);
+static inline uint16_t row_offset(uint8_t row);
+static inline uint8_t * row_used(uint8_t y);
+static inline void row_cleared(uint8_t y);
+
+#if defined(ENABLE_ROW_TABLE)
+static uint16_t * row_table;	//row*hres of each buffer row, see row_offset()
+#endif
+static uint8_t sleep_reg;		//sleep control register before set_sleep_sync(1)
+
 
 /* Call this to start video output with the default resolution.
  * 
@@ -75,45 +115,209 @@ char TVout::begin(uint8_t mode, uint8_t x, uint8_t y) {
  *    Pass NULL to allow the library to create it's own buffer.
  *    The buffer must be sized appropriately to represent a bit-mapped monochrome pixel buffer,
  *      aligned on single-byte-boundaries to the beginning of each line.
+ *    With set_hscroll() it needs a row of x/8 zeroed bytes more.
  *	mode:
  *		The video standard to follow:
  *		PAL		=1	=_PAL
  *		NTSC	=0	=_NTSC
+ *		Or'd with INTERLACED even rows go out on one field and odd rows on
+ *		the next, which fits twice the rows at the same cost per line.
  *	x:
  *		Horizonal resolution must be divisable by 8.
  *	y:
- *		Vertical resolution.
+ *		Vertical resolution, should be even when interlaced.
  *
  *	Returns:
  *		0 if no error.
  *		1 if x is not divisable by 8.
  *		2 if y is to large (NTSC only cannot fill PAL vertical resolution by 8bit limit)
+ *		3 if x is too wide for F_CPU, 3 cycles a pixel (4 when VID_PIN is not
+ *		bit 7) or 2 with the usart.
  *		4 if there is not enough memory for the frame buffer.
  */
 char TVout::begin(unsigned char *screenBuffer, uint8_t mode, uint8_t x, uint8_t y) {
 	// check if x is divisable by 8
 	if ( !(x & 0xF8))
 		return 1;
+	if (!(mode & INTERLACED) && y > ((mode & PAL) ? _PAL_LINE_DISPLAY : _NTSC_LINE_DISPLAY))
+		return 2;
+#if defined(UDR_VID)
+	if (_CYCLES_ACTIVE/x < 2)
+#else
+	if (_CYCLES_ACTIVE/x < _CPP_MIN)
+#endif
+		return 3;
 	x = x/8;
 		
-  screen = screenBuffer ?: (unsigned char*)malloc(x * y * sizeof(unsigned char));
+	// a zeroed row more, the last row scrolled by set_hscroll() reads into it.
+  screen = screenBuffer ?: (unsigned char*)calloc(x * (y+1), sizeof(unsigned char));
 	if (screen == NULL)
 		return 4;
 		
 	cursor_x = 0;
 	cursor_y = 0;
 	
+	display.font = NULL;
+	display.back = NULL;
+	display.empty = (uint8_t*)malloc((y+7)/8);
+	display.draw_empty = display.empty;
+	display.skip_empty = 0;
+#if defined(ENABLE_ROW_TABLE)
+	free(row_table);
+	row_table = (uint16_t*)malloc(y*sizeof(uint16_t));
+	for (uint8_t i = 0; row_table && i < y; i++)
+		row_table[i] = i*x;
+#endif
 	render_setup(mode,x,y,screen);
 	clear_screen();
 	return 0;
 } // end of begin
 
 
+/* call this to start double buffered video output.
+ * The drawing functions draw to the back buffer while the other one is
+ * shown, flip() swaps them at the end of the next active area so a frame is
+ * never shown half drawn. Needs twice the memory, x/8*y bytes each, which
+ * at 128x96 only fits on 1284P/2560 class parts.
+ *
+ * Arguments:
+ *  screenBuffer:
+ *    Optional pointer to an existing screen buffer.
+ *    Pass NULL to allow the library to create it's own buffer.
+ *  backBuffer:
+ *    Optional pointer to a second buffer the same size, with the same
+ *    extra row for set_hscroll().
+ *    Pass NULL to allow the library to create it's own buffer.
+ *	mode:
+ *		The video standard to follow:
+ *		PAL		=1	=_PAL
+ *		NTSC	=0	=_NTSC
+ *	x:
+ *		Horizonal resolution must be divisable by 8.
+ *	y:
+ *		Vertical resolution.
+ *
+ *	Returns:
+ *		0 if no error.
+ *		1 if x is not divisable by 8.
+ *		4 if there is not enough memory for the buffers.
+ */
+char TVout::begin(unsigned char *screenBuffer, unsigned char *backBuffer, uint8_t mode, uint8_t x, uint8_t y) {
+	char r;
+	
+	if ( !(x & 0xF8))
+		return 1;
+	back = backBuffer ?: (unsigned char*)calloc(x/8 * (y+1), 1);
+	if (back == NULL)
+		return 4;
+	r = begin(screenBuffer,mode,x,y);
+	if (r) {
+		if (!backBuffer)
+			free(back);
+		back = NULL;
+		return r;
+	}
+	
+	display.back = back;
+	display.draw = back;
+	// each buffer has its own empty flags, skipping is off if they don't fit.
+	display.draw_empty = (uint8_t*)malloc((y+7)/8);
+	if (!display.draw_empty) {
+		free(display.empty);
+		display.empty = NULL;
+	}
+	clear_screen();
+	return 0;
+} // end of begin
+
+
+/* call this to start video output in text mode.
+ * The screen holds one character code per 8x8 cell instead of pixels, the
+ * glyphs are read from the font while each line is rendered. 128x96 takes
+ * 192 bytes instead of 1536. Only printing works in text mode, the other
+ * drawing functions expect pixels.
+ * Resolutions that would need the 3 or 5 cycle kernels use the 4 cycle one,
+ * or the 6 cycle one when VID_PIN is not bit 7, which makes the picture
+ * narrower.
+ *
+ * Arguments:
+ *	mode:
+ *		The video standard to follow:
+ *		PAL		=1	=_PAL
+ *		NTSC	=0	=_NTSC
+ *	x:
+ *		Horizonal resolution must be divisable by 8.
+ *	y:
+ *		Vertical resolution must be divisable by 8.
+ *	f:
+ *		An 8x8 font, font8x8 or font8x8ext.
+ *	textBuffer:
+ *		Optional buffer of x/8 * y/8 characters, x/8 more for set_hscroll().
+ *		Pass NULL to allow the library to create it's own buffer.
+ *
+ *	Returns:
+ *		0 if no error.
+ *		1 if x is not divisable by 8.
+ *		3 if y is not divisable by 8, the font is not 8x8 or x needs less
+ *		than 4 cycles per pixel (6 when VID_PIN is not bit 7).
+ *		4 if there is not enough memory for the text buffer.
+ */
+char TVout::begin_text(uint8_t mode, uint8_t x, uint8_t y, const unsigned char * f, unsigned char * textBuffer) {
+	if ( !(x & 0xF8))
+		return 1;
+	if ((y & 7) || pgm_read_byte(f) != 8 || pgm_read_byte(f+1) != 8 ||
+			_CYCLES_ACTIVE/x < _CPP_MIN_TEXT)
+		return 3;
+	x = x/8;
+	
+	screen = textBuffer ?: (unsigned char*)calloc(x * (y/8+1), 1);
+	if (screen == NULL)
+		return 4;
+	
+	cursor_x = 0;
+	cursor_y = 0;
+	font = f;
+	
+	display.font = f + 3 - pgm_read_byte(f+2)*8;
+	display.attr = NULL;
+	display.back = NULL;
+	render_setup(mode,x,y,screen);
+	clear_screen();
+	return 0;
+} // end of begin_text
+
+
+/* set the attributes of a text mode screen.
+ * One byte per character cell that is xored with every row of its glyph,
+ * 0 shows the glyph as is and 0xff inverts it. Ignored at the resolutions
+ * that use the 4 cycle text kernel.
+ *
+ * Arguments:
+ *	attr:
+ *		x/8 * y/8 attribute bytes, or NULL for none.
+ */
+void TVout::set_text_attr(unsigned char * attr) {
+	display.attr = attr;
+} // end of set_text_attr
+
+
 /* Stop video render and free the used memory.
  */
  void TVout::end() {
 	TIMSK1 = 0;
+	set_sleep_sync(0);
 	free(screen);
+	free(back);
+	back = NULL;
+	if (display.draw_empty != display.empty)
+		free(display.draw_empty);
+	free(display.empty);
+	display.empty = NULL;
+	display.draw_empty = NULL;
+#if defined(ENABLE_ROW_TABLE)
+	free(row_table);
+	row_table = NULL;
+#endif
 }
 
 
@@ -125,24 +329,42 @@ char TVout::begin(unsigned char *screenBuffer, uint8_t mode, uint8_t x, uint8_t
  *		(see color note at the top of this file)
 */
 void TVout::fill(uint8_t color) {
+	// text mode, clear to spaces and color with the attributes.
+	if (display.font) {
+		int n = display.hres*(display.vres/8);
+		
+		if (color == BLACK || color == WHITE) {
+			cursor_x = 0;
+			cursor_y = 0;
+			memset(display.draw, ' ', n);
+		}
+		if (display.attr) {
+			for (int i = 0; i < n; i++)
+				display.attr[i] = color == BLACK ? 0 : (color == WHITE ? 0xff : ~display.attr[i]);
+		}
+		return;
+	}
+	
 	switch(color) {
 		case BLACK:
 			cursor_x = 0;
 			cursor_y = 0;
 			for (int i = 0; i < (display.hres)*display.vres; i++)
-				display.screen[i] = 0;
+				display.draw[i] = 0;
 			break;
 		case WHITE:
 			cursor_x = 0;
 			cursor_y = 0;
 			for (int i = 0; i < (display.hres)*display.vres; i++)
-				display.screen[i] = 0xFF;
+				display.draw[i] = 0xFF;
 			break;
 		case INVERT:
 			for (int i = 0; i < display.hres*display.vres; i++)
-				display.screen[i] = ~display.screen[i];
+				display.draw[i] = ~display.draw[i];
 			break;
 	}
+	if (display.draw_empty)
+		memset(display.draw_empty, color == BLACK ? 0xff : 0, (display.vres+7)/8);
 } // end of fill
 
 
@@ -166,6 +388,63 @@ unsigned char TVout::vres() {
 } // end of vres
 
 
+/* Gets the spread of the active line entry time over the last frame
+ * The time is sampled from TCNT1 before the line waits for its output start,
+ * so this is how many cycles the start of a line moved around. It should be
+ * 0 with set_sleep_sync(1).
+ *
+ * Returns:
+ *	The difference between the latest and earliest entry in cycles.
+*/
+unsigned char TVout::jitter() {
+	return display.jitter;
+} // end of jitter
+
+
+#if defined(ENABLE_CPU_STATS)
+/* Get the line interrupt statistics of the last complete frame.
+ * Only available with ENABLE_CPU_STATS defined in video_gen.h.
+ * isr_cycles/frame_cycles is the share of the cpu video generation took,
+ * the rest is what the sketch had.
+ *
+ * Arguments:
+ *	s:
+ *		The struct to copy the statistics to.
+ */
+void TVout::cpu_stats(TVout_stats * s) {
+	uint8_t sreg = SREG;
+	cli();
+	*s = frame_stats;
+	SREG = sreg;
+} // end of cpu_stats
+
+
+/* Draw the cpu load of the last frame as a bar.
+ * The white part is the share taken by video generation.
+ *
+ * Arguments:
+ *	x:
+ *		The x coordinate of the left end of the bar.
+ *	y:
+ *		The row to draw the bar on.
+ *	w:
+ *		The width of the bar, a full bar is 100% load.
+ */
+void TVout::draw_cpu_bar(uint8_t x, uint8_t y, uint8_t w) {
+	TVout_stats s;
+	uint8_t load = 0;
+	
+	cpu_stats(&s);
+	if (s.frame_cycles)
+		load = s.isr_cycles * w / s.frame_cycles;
+	if (load)
+		draw_row(y, x, x + load, WHITE);
+	if (load < w)
+		draw_row(y, x + load, x + w, BLACK);
+} // end of draw_cpu_bar
+#endif
+
+
 /* Return the number of characters that will fit on a line
  *
  * Returns:
@@ -198,7 +477,7 @@ void TVout::delay(unsigned int x) {
  *		The number of frames to delay for.
  */
 void TVout::delay_frame(unsigned int x) {
-	int stop_line = (int)(display.start_render + (display.vres*(display.vscale_const+1)))+1;
+	int stop_line = (int)(display.start_render + render_lines())+1;
 	while (x) {
 		while (display.scanLine != stop_line);
 		while (display.scanLine == stop_line);
@@ -207,6 +486,37 @@ void TVout::delay_frame(unsigned int x) {
 } // end of delay_frame
 
 
+/* Get the parity of the rows the current field shows.
+ * Interlaced, the rows of the other parity are not on screen until the next
+ * field so they can be changed without tearing.
+ *
+ * Returns:
+ *	0 for the even rows, 1 for the odd rows. Always 0 when not interlaced.
+ */
+uint8_t TVout::field() {
+	return display.field;
+} // end of field
+
+
+/* Delay until a field of the given parity starts.
+ * It starts in the vertical blank, so drawing to the other parity's rows
+ * right after this has the whole field to finish.
+ * Not interlaced, this is delay_frame(1).
+ *
+ * Arguments:
+ *	parity:
+ *		0 for the field of even rows, 1 for the odd rows.
+ */
+void TVout::delay_field(uint8_t parity) {
+	if (!display.interlace) {
+		delay_frame(1);
+		return;
+	}
+	while (display.field == parity);
+	while (display.field != parity);
+} // end of delay_field
+
+
 /* Get the time in ms since begin was called.
  * The resolution is 16ms for NTSC and 20ms for PAL
  *
@@ -233,9 +543,61 @@ void TVout::force_vscale(char sfactor) {
 	delay_frame(1);
 	display.vscale_const = sfactor - 1;
 	display.vscale = sfactor - 1;
+	schedule_setup();
 }
 
 
+/* split the screen into zones with their own vertical scale.
+ * The zones take the screen rows from the top in order, each row of a zone
+ * is shown on vscale lines. A 2x headline, a normal body and a 1x status
+ * line only need the rows the headline and body take at their scale
+ * instead of the whole screen at the densest. The picture is centered
+ * again for the new number of lines.
+ *
+ * Arguments:
+ *	zones:
+ *		The zones, their rows must add up to vres. NULL to go back to the
+ *		same scale everywhere.
+ *	count:
+ *		The number of zones.
+ *
+ * Returns:
+ *	0 if no error.
+ *	1 if the rows do not add up to vres, a zone has no rows, a vscale is 0
+ *	or the output is interlaced.
+ *	2 if the zones take more lines than the standard can show.
+ */
+char TVout::set_zones(TVout_zone * zones, uint8_t count) {
+	int rows = 0, lines = 0;
+	uint8_t i;
+	
+	if (display.interlace)
+		return 1;
+	for (i = 0; zones && i < count; i++) {
+		if (!zones[i].vscale || !zones[i].rows)
+			return 1;
+		rows += zones[i].rows;
+		lines += zones[i].rows*zones[i].vscale;
+	}
+	if (!zones)
+		lines = display.vres*(display.vscale_const+1);
+	else if (rows != display.vres)
+		return 1;
+	if (lines > (display.lines_frame == _PAL_LINE_FRAME ? _PAL_LINE_DISPLAY : _NTSC_LINE_DISPLAY))
+		return 2;
+	
+	delay_frame(1);
+	display.zones = zones;
+	display.zone_count = count;
+	if (display.lines_frame == _PAL_LINE_FRAME)
+		display.start_render = _PAL_LINE_MID - lines/2;
+	else
+		display.start_render = _NTSC_LINE_MID - lines/2 + 8;
+	schedule_setup();
+	return 0;
+} // end of set_zones
+
+
 /* force the output start time of a scanline in micro seconds.
  *
  * Arguments:
@@ -245,6 +607,35 @@ void TVout::force_vscale(char sfactor) {
 void TVout::force_outstart(uint8_t time) {
 	delay_frame(1);
 	display.output_delay = ((time * _CYCLES_PER_US) - 1);
+	OCR1B = display.output_delay - _CYCLES_SYNC_WAKE;
+}
+
+
+/* Sleep synchronize the start of active lines.
+ * Before each active line the cpu idles until a compare match on OCR1B
+ * shortly before the output start. Waking from sleep always takes the same
+ * time, so rendering starts on the same cycle no matter which instruction
+ * the interrupt landed on. Other interrupts are serviced during the wait.
+ * Lines where the interrupt is already too late to sleep render as usual.
+ * Turning it on sets idle sleep mode and enables sleep, turning it off puts
+ * back the sleep settings there were before.
+ *
+ * Arguments:
+ *	sync:
+ *		1 to sleep synchronize, 0 (default) to only rely on the timer.
+ */
+void TVout::set_sleep_sync(char sync) {
+	if (sync && !display.sleep_sync) {
+		sleep_reg = _SLEEP_CONTROL_REG;
+		set_sleep_mode(SLEEP_MODE_IDLE);
+		sleep_enable();
+		display.sleep_sync = 1;
+	}
+	else if (!sync && display.sleep_sync) {
+		// the interrupt must not sleep in the restored mode.
+		display.sleep_sync = 0;
+		_SLEEP_CONTROL_REG = sleep_reg;
+	}
 }
 
 
@@ -257,6 +648,7 @@ void TVout::force_outstart(uint8_t time) {
 void TVout::force_linestart(uint8_t line) {
 	delay_frame(1);
 	display.start_render = line;
+	schedule_setup();
 }
 
 
@@ -295,7 +687,7 @@ void TVout::set_pixel(uint8_t x, uint8_t y, char c) {
 unsigned char TVout::get_pixel(uint8_t x, uint8_t y) {
 	if (x >= display.hres*8 || y >= display.vres)
 		return 0;
-	if (display.screen[x/8+y*display.hres] & (0x80 >>(x&7)))
+	if (row_addr(y)[x/8] & pixel_mask[x&7])
 		return 1;
 	return 0;
 } // end of get_pixel
@@ -326,65 +718,42 @@ void TVout::draw_line(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1, char c) {
 	else if (y0 == y1)
 		draw_row(y0,x0,x1,c);
 	else {
-		int e;
-		signed int dx,dy,j, temp;
-		signed char s1,s2, xchange;
-		signed int x,y;
-
-		x = x0;
-		y = y0;
-	
-		//take absolute value
+		uint8_t dx, dy, y, n;
+		int step;
+		
+		// always walk left to right, y goes up or down a row at a time.
 		if (x1 < x0) {
-			dx = x0 - x1;
-			s1 = -1;
-		}
-		else if (x1 == x0) {
-			dx = 0;
-			s1 = 0;
-		}
-		else {
-			dx = x1 - x0;
-			s1 = 1;
+			dx = x0;
+			x0 = x1;
+			x1 = dx;
+			dx = y0;
+			y0 = y1;
+			y1 = dx;
 		}
-
+		dx = x1 - x0;
 		if (y1 < y0) {
 			dy = y0 - y1;
-			s2 = -1;
-		}
-		else if (y1 == y0) {
-			dy = 0;
-			s2 = 0;
+			step = -display.hres;
 		}
 		else {
 			dy = y1 - y0;
-			s2 = 1;
+			step = display.hres;
 		}
-
-		xchange = 0;   
-
-		if (dy>dx) {
-			temp = dx;
-			dx = dy;
-			dy = temp;
-			xchange = 1;
-		} 
-
-		e = ((int)dy<<1) - dx;  
-	 
-		for (j=0; j<=dx; j++) {
-			sp(x,y,c);
-		 
-			if (e>=0) {
-				if (xchange==1) x = x + s1;
-				else y = y + s2;
-				e = e - ((int)dx<<1);
-			}
-			if (xchange==1)
-				y = y + s2;
-			else
-				x = x + s1;
-			e = e + ((int)dy<<1);
+		
+		// the rows are marked once up front instead of for every pixel.
+		if (c != BLACK)
+			for (y = y0 < y1 ? y0 : y1, n = dy + 1; n; y++, n--)
+				row_used(y);
+		
+		switch (c) {
+			case WHITE:
+				line_walk(row_addr(y0) + x0/8, x0, dx, dy, step, WHITE);
+				break;
+			case BLACK:
+				line_walk(row_addr(y0) + x0/8, x0, dx, dy, step, BLACK);
+				break;
+			default:
+				line_walk(row_addr(y0) + x0/8, x0, dx, dy, step, INVERT);
 		}
 	}
 } // end of draw_line
@@ -415,30 +784,30 @@ void TVout::draw_row(uint8_t line, uint16_t x0, uint16_t x1, uint8_t c) {
 			x1 = lbit;
 		}
 		lbit = 0xff >> (x0&7);
-		x0 = x0/8 + display.hres*line;
+		x0 = x0/8 + ((c == BLACK ? row_addr(line) : row_used(line)) - display.draw);
 		rbit = ~(0xff >> (x1&7));
-		x1 = x1/8 + display.hres*line;
+		x1 = x1/8 + (row_addr(line) - display.draw);
 		if (x0 == x1) {
 			lbit = lbit & rbit;
 			rbit = 0;
 		}
 		if (c == WHITE) {
-			screen[x0++] |= lbit;
+			display.draw[x0++] |= lbit;
 			while (x0 < x1)
-				screen[x0++] = 0xff;
-			screen[x0] |= rbit;
+				display.draw[x0++] = 0xff;
+			display.draw[x0] |= rbit;
 		}
 		else if (c == BLACK) {
-			screen[x0++] &= ~lbit;
+			display.draw[x0++] &= ~lbit;
 			while (x0 < x1)
-				screen[x0++] = 0;
-			screen[x0] &= ~rbit;
+				display.draw[x0++] = 0;
+			display.draw[x0] &= ~rbit;
 		}
 		else if (c == INVERT) {
-			screen[x0++] ^= lbit;
+			display.draw[x0++] ^= lbit;
 			while (x0 < x1)
-				screen[x0++] ^= 0xff;
-			screen[x0] ^= rbit;
+				display.draw[x0++] ^= 0xff;
+			display.draw[x0] ^= rbit;
 		}
 	}
 } // end of draw_row
@@ -460,7 +829,8 @@ void TVout::draw_row(uint8_t line, uint16_t x0, uint16_t x1, uint8_t c) {
 void TVout::draw_column(uint8_t row, uint16_t y0, uint16_t y1, uint8_t c) {
 
 	unsigned char bit;
-	int byte;
+	uint8_t * byte;
+	uint8_t * end = display.draw + display.hres*display.vres;
 	
 	if (y0 == y1)
 		set_pixel(row,y0,c);
@@ -470,28 +840,21 @@ void TVout::draw_column(uint8_t row, uint16_t y0, uint16_t y1, uint8_t c) {
 			y0 = y1;
 			y1 = bit;
 		}
-		bit = 0x80 >> (row&7);
-		byte = row/8 + y0*display.hres;
-		if (c == WHITE) {
-			while ( y0 <= y1) {
-				screen[byte] |= bit;
-				byte += display.hres;
-				y0++;
-			}
-		}
-		else if (c == BLACK) {
-			while ( y0 <= y1) {
-				screen[byte] &= ~bit;
-				byte += display.hres;
-				y0++;
-			}
-		}
-		else if (c == INVERT) {
-			while ( y0 <= y1) {
-				screen[byte] ^= bit;
-				byte += display.hres;
-				y0++;
-			}
+		bit = pixel_mask[row&7];
+		byte = row_addr(y0) + row/8;
+		while (y0 <= y1) {
+			if (c != BLACK)
+				row_used(y0);
+			if (c == WHITE)
+				*byte |= bit;
+			else if (c == BLACK)
+				*byte &= ~bit;
+			else if (c == INVERT)
+				*byte ^= bit;
+			byte += display.hres;
+			if (byte >= end)
+				byte -= display.hres*display.vres;
+			y0++;
 		}
 	}
 }
@@ -601,6 +964,148 @@ void TVout::draw_circle(uint8_t x0, uint8_t y0, uint8_t radius, char c, char fc)
 } // end of draw_circle
 
 
+/* draw a filled triangle.
+ * The corners may be off the screen, what is off is clipped.
+ *
+ * Arguments:
+ *	x0,y0:
+ *	x1,y1:
+ *	x2,y2:
+ *		The corners, in any order.
+ *	c:
+ *		The color of the triangle.
+ *		(see color note at the top of this file)
+ */
+void TVout::fill_triangle(int x0, int y0, int x1, int y1, int x2, int y2, char c) {
+	int points[6] = {x0, y0, x1, y1, x2, y2};
+	
+	fill_polygon(points, 3, c);
+} // end of fill_triangle
+
+
+/* draw a filled convex polygon.
+ * Two edges are walked down from the top corner, one each way around the
+ * polygon, with integer steps. Each row is then one span between them
+ * filled a byte at a time. Corners may be off the screen, rows and spans
+ * are clipped. Keep coordinates within +-16000 so the steps fit an int.
+ * Polygons that are not convex are drawn wrong but safely.
+ *
+ * Arguments:
+ *	points:
+ *		The corners in order around the polygon, x0,y0,x1,y1,...
+ *		either way around.
+ *	n:
+ *		The number of corners, at least 3.
+ *	c:
+ *		The color of the polygon.
+ *		(see color note at the top of this file)
+ */
+void TVout::fill_polygon(const int * points, uint8_t n, char c) {
+	poly_edge l, r;
+	uint8_t i, top = 0, li, ri, ln, rn;
+	int y, ymax, x0, x1, k;
+	int xmax = display.hres*8 - 1;
+	
+	if (n < 3)
+		return;
+	x0 = x1 = points[0];
+	for (i = 1; i < n; i++) {
+		if (points[2*i+1] < points[2*top+1])
+			top = i;
+		if (points[2*i] < x0)
+			x0 = points[2*i];
+		if (points[2*i] > x1)
+			x1 = points[2*i];
+	}
+	y = points[2*top+1];
+	ymax = y;
+	for (i = 0; i < n; i++)
+		if (points[2*i+1] > ymax)
+			ymax = points[2*i+1];
+	if (ymax < 0 || y >= display.vres)
+		return;
+	
+	// a flat polygon is one row from the leftmost to the rightmost corner.
+	if (y == ymax) {
+		l.x = x0;
+		r.x = x1;
+		l.rows = r.rows = 0;
+		ln = rn = 0;
+	}
+	else {
+		l.x = r.x = points[2*top];
+		l.rows = r.rows = 0;
+		ln = rn = n;
+	}
+	li = ri = top;
+	
+	for (; y <= ymax && y < display.vres; y++) {
+		// move on to the next edge that goes down, past flat ones.
+		while (!l.rows && ln) {
+			i = li ? li - 1 : n - 1;
+			if (points[2*i+1] < points[2*li+1])
+				break;
+			edge_start(&l, points + 2*li, points + 2*i);
+			li = i;
+			ln--;
+		}
+		while (!r.rows && rn) {
+			i = ri + 1 < n ? ri + 1 : 0;
+			if (points[2*i+1] < points[2*ri+1])
+				break;
+			edge_start(&r, points + 2*ri, points + 2*i);
+			ri = i;
+			rn--;
+		}
+		
+		// rows above the screen go by an edge or the rest of the way to
+		// the top at a time, not a row at a time.
+		if (y < 0) {
+			k = -y;
+			if (l.rows && l.rows < k)
+				k = l.rows;
+			if (r.rows && r.rows < k)
+				k = r.rows;
+			edge_skip(&l, k);
+			edge_skip(&r, k);
+			y += k - 1;
+			continue;
+		}
+		
+		if (l.x < r.x) {
+			x0 = l.x;
+			x1 = r.x;
+		}
+		else {
+			x0 = r.x;
+			x1 = l.x;
+		}
+		if (x1 >= 0 && x0 <= xmax) {
+			if (x0 < 0)
+				x0 = 0;
+			if (x1 > xmax)
+				x1 = xmax;
+			switch (c) {
+				case WHITE:
+					span(row_used(y), x0, x1, WHITE);
+					break;
+				case BLACK:
+					span(row_addr(y), x0, x1, BLACK);
+					break;
+				case INVERT:
+					span(row_used(y), x0, x1, INVERT);
+					break;
+			}
+		}
+		
+		if (l.rows)
+			edge_step(&l);
+		if (r.rows)
+			edge_step(&r);
+	}
+} // end of fill_polygon
+
+
 /* place a bitmap at x,y where the bitmap is defined as {width,height,imagedata....}
  *
  * Arguments:
@@ -648,32 +1153,219 @@ void TVout::bitmap(uint8_t x, uint8_t y, const unsigned char * bmp,
 	}
 	
 	for (uint8_t l = 0; l < lines; l++) {
-		si = (y + l)*display.hres + x/8;
+		si = row_used(y + l) - display.draw + x/8;
 		if (width == 1)
 			temp = 0xff >> rshift + xtra;
 		else
 			temp = 0;
-		save = screen[si];
-		screen[si] &= ((0xff << lshift) | temp);
+		save = display.draw[si];
+		display.draw[si] &= ((0xff << lshift) | temp);
 		temp = pgm_read_byte((uint32_t)(bmp) + i++);
-		screen[si++] |= temp >> rshift;
+		display.draw[si++] |= temp >> rshift;
 		for ( uint16_t b = i + width-1; i < b; i++) {
-			save = screen[si];
-			screen[si] = temp << lshift;
+			save = display.draw[si];
+			display.draw[si] = temp << lshift;
 			temp = pgm_read_byte((uint32_t)(bmp) + i);
-			screen[si++] |= temp >> rshift;
+			display.draw[si++] |= temp >> rshift;
 		}
 		if (rshift + xtra < 8)
-			screen[si-1] |= (save & (0xff >> rshift + xtra));	//test me!!!
+			display.draw[si-1] |= (save & (0xff >> rshift + xtra));	//test me!!!
 		if (rshift + xtra - 8 > 0)
-			screen[si] &= (0xff >> rshift + xtra - 8);
-		screen[si] |= temp << lshift;
+			display.draw[si] &= (0xff >> rshift + xtra - 8);
+		display.draw[si] |= temp << lshift;
 	}
 } // end of bitmap
 
 
+/* copy a rectangle of pixels from one buffer to another with a raster op.
+ * Buffers are images laid out like bitmap(), {width,height,rows...} with
+ * each row padded to whole bytes, or NULL for the screen. Each row is read
+ * into a line buffer already shifted to the bit alignment of the
+ * destination, then combined with it a byte at a time. The two edge masks
+ * are worked out once. Copies within one buffer may overlap.
+ *
+ * Arguments:
+ *	src:
+ *		The image to copy from, NULL for the screen.
+ *	sx:
+ *		The x coordinate of the rectangle in src.
+ *	sy:
+ *		The y coordinate of the rectangle in src.
+ *	w:
+ *		The width of the rectangle.
+ *	h:
+ *		The height of the rectangle.
+ *	dst:
+ *		The image in ram to copy to, NULL for the screen.
+ *	dx:
+ *		The x coordinate to put the rectangle at in dst, may be negative.
+ *	dy:
+ *		The y coordinate to put the rectangle at in dst, may be negative.
+ *		What falls outside either buffer is clipped.
+ *	rop:
+ *		How source pixels s change destination pixels d.
+ *		BLIT_COPY	d = s
+ *		BLIT_OR		d = d | s
+ *		BLIT_AND	d = d & s
+ *		BLIT_XOR	d = d ^ s
+ *		BLIT_ANDNOT	d = d & ~s
+ *		or BLIT_PGM in if src is in PROGMEM.
+ *		default =BLIT_COPY
+ */
+void TVout::blit(const unsigned char * src, uint8_t sx, uint8_t sy, uint8_t w, uint8_t h,
+				 unsigned char * dst, int dx, int dy, uint8_t rop) {
+	uint8_t line[34];
+	uint8_t pgm = src ? rop & BLIT_PGM : 0;
+	uint8_t sw, sh, dw, dh, sstride, dstride, n, lmask, rmask, shift, i, row, k;
+	const uint8_t * s;
+	uint8_t * d;
+	int base, b, step;
+	
+	rop &= ~BLIT_PGM;
+	if (rop > BLIT_ANDNOT)
+		return;
+	if (!src) {
+		sw = display.hres*8;
+		sh = display.vres;
+	}
+	else if (pgm) {
+		sw = pgm_read_byte((uint32_t)(src));
+		sh = pgm_read_byte((uint32_t)(src) + 1);
+	}
+	else {
+		sw = src[0];
+		sh = src[1];
+	}
+	if (!dst) {
+		dw = display.hres*8;
+		dh = display.vres;
+	}
+	else {
+		dw = dst[0];
+		dh = dst[1];
+	}
+	sstride = (sw + 7)/8;
+	dstride = (dw + 7)/8;
+	
+	// clip to both buffers.
+	if (dx < 0) {
+		if (-dx >= w || sx - dx >= sw)
+			return;
+		sx += -dx;
+		w += dx;
+		dx = 0;
+	}
+	if (dy < 0) {
+		if (-dy >= h || sy - dy >= sh)
+			return;
+		sy += -dy;
+		h += dy;
+		dy = 0;
+	}
+	if (sx >= sw || sy >= sh || dx >= dw || dy >= dh)
+		return;
+	if (w > sw - sx)
+		w = sw - sx;
+	if (w > dw - dx)
+		w = dw - dx;
+	if (h > sh - sy)
+		h = sh - sy;
+	if (h > dh - dy)
+		h = dh - dy;
+	if (!w || !h)
+		return;
+	
+	// destination bytes per row and the masks of the first and last.
+	n = ((dx&7) + w + 7)/8;
+	lmask = left_mask[dx&7];
+	rmask = right_mask[(dx + w - 1)&7];
+	if (n == 1)
+		lmask &= rmask;
+	
+	// the source byte and bit under the first pixel of the first
+	// destination byte, up to 7 pixels left of the row.
+	b = sx - (dx&7) + 8;
+	base = b/8 - 1;
+	shift = b&7;
+	
+	// moving down within a buffer goes bottom up so rows are read before
+	// they are written over, sideways is safe as rows are read whole first.
+	row = 0;
+	step = 1;
+	if (src == dst && dy > sy) {
+		row = h - 1;
+		step = -1;
+	}
+	for (k = h; k; k--, row += step) {
+		if (!src)
+			s = row_addr(sy + row);
+		else
+			s = src + 2 + (sy + row)*sstride;
+		for (i = 0, b = base; i <= n; i++, b++) {
+			if (b < 0 || b >= sstride)
+				line[i] = 0;
+			else if (pgm)
+				line[i] = pgm_read_byte((uint32_t)(s) + b);
+			else
+				line[i] = s[b];
+		}
+		if (shift)
+			for (i = 0; i < n; i++)
+				line[i] = (line[i] << shift) | (line[i+1] >> (8 - shift));
+		
+		if (dst)
+			d = dst + 2 + (dy + row)*dstride + dx/8;
+		else if (rop == BLIT_AND || rop == BLIT_ANDNOT)
+			d = row_addr(dy + row) + dx/8;
+		else
+			d = row_used(dy + row) + dx/8;
+		switch (rop) {
+			case BLIT_COPY:
+				blit_row(d, line, n, lmask, rmask, BLIT_COPY);
+				break;
+			case BLIT_OR:
+				blit_row(d, line, n, lmask, rmask, BLIT_OR);
+				break;
+			case BLIT_AND:
+				blit_row(d, line, n, lmask, rmask, BLIT_AND);
+				break;
+			case BLIT_XOR:
+				blit_row(d, line, n, lmask, rmask, BLIT_XOR);
+				break;
+			default:
+				blit_row(d, line, n, lmask, rmask, BLIT_ANDNOT);
+				break;
+		}
+	}
+} // end of blit
+
+
+/* move the rows of a text mode buffer up or down.
+ * A text screen is small enough that moving it is cheaper than keeping it
+ * as a ring.
+*/
+static void shift_text(uint8_t * buf, uint8_t fill, uint8_t rows, uint8_t direction) {
+	uint8_t trows = display.vres/8;
+	int n;
+	
+	if (rows > trows)
+		rows = trows;
+	n = (trows - rows)*display.hres;
+	if (direction == UP) {
+		memmove(buf, buf + rows*display.hres, n);
+		memset(buf + n, fill, rows*display.hres);
+	}
+	else {
+		memmove(buf + rows*display.hres, buf, n);
+		memset(buf, fill, rows*display.hres);
+	}
+} // end of shift_text
+
+
 /* shift the pixel buffer in any direction
  * This function will shift the screen in a direction by any distance.
+ * UP and DOWN only clear the rows that come into view and move the start of
+ * the screen buffer ring, LEFT and RIGHT still move every byte.
  *
  * Arguments:
  *	distance:
@@ -691,36 +1383,39 @@ void TVout::shift(uint8_t distance, uint8_t direction) {
 	uint8_t * end;
 	uint8_t shift;
 	uint8_t tmp;
+	uint8_t line;
+	
+	if (display.font) {
+		if (direction == UP || direction == DOWN) {
+			shift_text(display.draw, ' ', distance/8, direction);
+			if (display.attr)
+				shift_text(display.attr, 0, distance/8, direction);
+		}
+		return;
+	}
+	if (distance > display.vres && (direction == UP || direction == DOWN))
+		distance = display.vres;
 	switch(direction) {
 		case UP:
-			dst = display.screen;
-			src = display.screen + distance*display.hres;
-			end = display.screen + display.vres*display.hres;
-				
-			while (src <= end) {
-				*dst = *src;
-				*src = 0;
-				dst++;
-				src++;
+			// the rows scrolled off the top come back in at the bottom.
+			for (line = 0; line < distance; line++) {
+				memset(row_addr(line), 0, display.hres);
+				row_cleared(line);
 			}
+			display.draw_origin = (display.draw_origin + distance) % display.vres;
 			break;
 		case DOWN:
-			dst = display.screen + display.vres*display.hres;
-			src = dst - distance*display.hres;
-			end = display.screen;
-				
-			while (src >= end) {
-				*dst = *src;
-				*src = 0;
-				dst--;
-				src--;
+			for (line = display.vres - distance; line < display.vres; line++) {
+				memset(row_addr(line), 0, display.hres);
+				row_cleared(line);
 			}
+			display.draw_origin = (display.draw_origin + display.vres - distance) % display.vres;
 			break;
 		case LEFT:
 			shift = distance & 7;
 			
 			for (uint8_t line = 0; line < display.vres; line++) {
-				dst = display.screen + display.hres*line;
+				dst = display.draw + display.hres*line;
 				src = dst + distance/8;
 				end = dst + display.hres-2;
 				while (src <= end) {
@@ -742,7 +1437,7 @@ void TVout::shift(uint8_t distance, uint8_t direction) {
 			shift = distance & 7;
 			
 			for (uint8_t line = 0; line < display.vres; line++) {
-				dst = display.screen + display.hres-1 + display.hres*line;
+				dst = display.draw + display.hres-1 + display.hres*line;
 				src = dst - distance/8;
 				end = dst - display.hres+2;
 				while (src >= end) {
@@ -761,22 +1456,364 @@ void TVout::shift(uint8_t distance, uint8_t direction) {
 			}
 			break;
 	}
+	// without a back buffer the buffer drawn to is the one shown.
+	if (!display.back)
+		display.origin = display.draw_origin;
 } // end of shift
 
 
+/* Apply a color to the pixels of mask in a byte.
+ * Always inlined with a constant color, so the loops calling it get one
+ * version per color with no color test inside.
+*/
+static void inline __attribute__((always_inline)) put(uint8_t * p, uint8_t mask, char c) {
+	if (c == WHITE)
+		*p |= mask;
+	else if (c == BLACK)
+		*p &= ~mask;
+	else
+		*p ^= mask;
+} // end of put
+
+
+/* Bresenham on a buffer pointer and a bit mask.
+ * Shallow lines gather the pixels of a row in a byte into one mask and
+ * write it when the line leaves the byte or the row, steep lines write a
+ * pixel per row. Rows wrap around the ring buffer like draw_column().
+ *
+ * Arguments:
+ *	p:
+ *		The byte of the first pixel.
+ *	x:
+ *		The x coordinate of the first pixel.
+ *	dx:
+ *		Pixels to the right of it.
+ *	dy:
+ *		Rows up or down.
+ *	step:
+ *		hres to go down a row, -hres to go up.
+ *	c:
+ *		WHITE, BLACK or INVERT, a constant.
+*/
+static void inline __attribute__((always_inline)) line_walk(uint8_t * p, uint8_t x, uint8_t dx, uint8_t dy, int step, char c) {
+	uint8_t * end = display.draw + display.hres*display.vres;
+	uint8_t mask = pixel_mask[x&7];
+	uint8_t run = 0;
+	uint8_t n;
+	int e;
+	
+	if (dx >= dy) {
+		e = 2*dy - dx;
+		for (n = dx + 1; n; n--) {
+			run |= mask;
+			if (e >= 0) {
+				put(p, run, c);
+				run = 0;
+				p += step;
+				if (p >= end)
+					p -= display.hres*display.vres;
+				else if (p < display.draw)
+					p += display.hres*display.vres;
+				e -= 2*dx;
+			}
+			e += 2*dy;
+			mask >>= 1;
+			if (!mask) {
+				if (run)
+					put(p, run, c);
+				run = 0;
+				mask = 0x80;
+				p++;
+			}
+		}
+		if (run)
+			put(p, run, c);
+	}
+	else {
+		e = 2*dx - dy;
+		for (n = dy + 1; n; n--) {
+			put(p, mask, c);
+			p += step;
+			if (p >= end)
+				p -= display.hres*display.vres;
+			else if (p < display.draw)
+				p += display.hres*display.vres;
+			if (e >= 0) {
+				mask >>= 1;
+				if (!mask) {
+					mask = 0x80;
+					p++;
+				}
+				e -= 2*dy;
+			}
+			e += 2*dx;
+		}
+	}
+} // end of line_walk
+
+
+/* Fill pixels x0 to x1 of a row, both included.
+ * The two end bytes take a mask from left_mask/right_mask, the bytes in
+ * between are written whole.
+ *
+ * Arguments:
+ *	p:
+ *		The first byte of the row.
+ *	x0:
+ *		The leftmost pixel.
+ *	x1:
+ *		The rightmost pixel, not left of x0.
+ *	c:
+ *		WHITE, BLACK or INVERT, a constant.
+*/
+static void inline __attribute__((always_inline)) span(uint8_t * p, uint8_t x0, uint8_t x1, char c) {
+	uint8_t * end = p + x1/8;
+	uint8_t mask = left_mask[x0&7];
+	
+	p += x0/8;
+	if (p == end) {
+		put(p, mask & right_mask[x1&7], c);
+		return;
+	}
+	put(p++, mask, c);
+	while (p != end)
+		put(p++, 0xff, c);
+	put(p, right_mask[x1&7], c);
+} // end of span
+
+
+/* Combine the pixels of mask in a byte with source pixels v.
+ * Always inlined with a constant rop like put().
+*/
+static void inline __attribute__((always_inline)) rop_byte(uint8_t * p, uint8_t v, uint8_t mask, uint8_t rop) {
+	if (rop == BLIT_COPY)
+		*p = (*p & ~mask) | (v & mask);
+	else if (rop == BLIT_OR)
+		*p |= v & mask;
+	else if (rop == BLIT_AND)
+		*p &= v | ~mask;
+	else if (rop == BLIT_XOR)
+		*p ^= v & mask;
+	else
+		*p &= ~(v & mask);
+} // end of rop_byte
+
+
+/* Combine a row of n bytes, the first under lmask, the last under rmask
+ * and the ones between whole. With n of 1 lmask is both.
+*/
+static void inline __attribute__((always_inline)) blit_row(uint8_t * p, const uint8_t * s, uint8_t n, uint8_t lmask, uint8_t rmask, uint8_t rop) {
+	rop_byte(p++, *s++, lmask, rop);
+	if (n == 1)
+		return;
+	for (n -= 2; n; n--)
+		rop_byte(p++, *s++, 0xff, rop);
+	rop_byte(p, *s, rmask, rop);
+} // end of blit_row
+
+
+/* Set up a polygon edge from corner a to corner b, b not above a.
+ * x starts at a and moves by q each row, plus s whenever the remainder
+ * adds up to a whole pixel, so it is at b after dy rows without a
+ * division per row. A flat edge gets no rows.
+*/
+static void edge_start(poly_edge * e, const int * a, const int * b) {
+	int dx = b[0] - a[0];
+	
+	e->x = a[0];
+	e->rows = b[1] - a[1];
+	if (!e->rows)
+		return;
+	e->dy = e->rows;
+	e->q = dx / e->dy;
+	e->r = dx % e->dy;
+	e->s = 1;
+	if (e->r < 0) {
+		e->r = -e->r;
+		e->s = -1;
+	}
+	// start half way so x rounds to the nearest pixel.
+	e->e = e->dy/2;
+} // end of edge_start
+
+
+/* Move an edge down a row.
+*/
+static void inline edge_step(poly_edge * e) {
+	e->x += e->q;
+	e->e += e->r;
+	if (e->e >= e->dy) {
+		e->e -= e->dy;
+		e->x += e->s;
+	}
+	e->rows--;
+} // end of edge_step
+
+
+/* Move an edge down k rows at once, the same as k edge_step()s.
+ * Does nothing to an edge with no rows left.
+*/
+static void edge_skip(poly_edge * e, int k) {
+	long sum;
+	
+	if (!e->rows)
+		return;
+	sum = e->e + (long)k*e->r;
+	e->x += k*e->q + (int)(sum/e->dy)*e->s;
+	e->e = sum % e->dy;
+	e->rows -= k;
+} // end of edge_skip
+
+
 /* Inline version of set_pixel that does not perform a bounds check
  * This function will be replaced by a macro.
 */
 static void inline sp(uint8_t x, uint8_t y, char c) {
 	if (c==1)
-		display.screen[(x/8) + (y*display.hres)] |= 0x80 >> (x&7);
+		row_used(y)[x/8] |= pixel_mask[x&7];
 	else if (c==0)
-		display.screen[(x/8) + (y*display.hres)] &= ~0x80 >> (x&7);
+		row_addr(y)[x/8] &= ~pixel_mask[x&7];
 	else
-		display.screen[(x/8) + (y*display.hres)] ^= 0x80 >> (x&7);
+		row_used(y)[x/8] ^= pixel_mask[x&7];
 } // end of sp
 
 
+/* Address of the first byte of row y.
+ * The screen buffer is a ring starting at display.draw_origin, so vertical
+ * shifts only move the origin. Everything drawing to the screen goes through
+ * this.
+*/
+static inline uint8_t * row_addr(uint8_t y) {
+	return display.draw + row_offset(row_of(y));
+} // end of row_addr
+
+
+/* Row of the draw buffer that row y is in.
+*/
+static inline uint8_t row_of(uint8_t y) {
+	uint16_t row = y + display.draw_origin;
+	
+	if (row >= display.vres)
+		row -= display.vres;
+	return row;
+} // end of row_of
+
+
+/* Offset of a row of the draw buffer from its start.
+*/
+static inline uint16_t row_offset(uint8_t row) {
+#if defined(ENABLE_ROW_TABLE)
+	if (row_table)
+		return row_table[row];
+#endif
+	return row*display.hres;
+} // end of row_offset
+
+
+/* row_addr() for drawing that may set pixels, clears the row's empty flag.
+*/
+static inline uint8_t * row_used(uint8_t y) {
+	uint8_t row = row_of(y);
+	
+	if (display.draw_empty)
+		display.draw_empty[row/8] &= ~_BV(row&7);
+	return display.draw + row_offset(row);
+} // end of row_used
+
+
+/* set the empty flag of a row that has just been cleared.
+*/
+static inline void row_cleared(uint8_t y) {
+	uint8_t row = row_of(y);
+	
+	if (display.draw_empty)
+		display.draw_empty[row/8] |= _BV(row&7);
+} // end of row_cleared
+
+
+/* skip rendering rows that are all black.
+ * The drawing functions keep a flag per row that is set when the row is
+ * cleared (fill(BLACK), shift()) and cleared when anything that can set a
+ * pixel touches it. Rows with the flag set output black without running
+ * the pixel loop, which gives the ~800 cycles of each of their lines back to
+ * the sketch. Drawing black over a row does not set the flag again, call
+ * scan_empty() for that. Pixels written straight to screen[], or to a
+ * buffer given to begin(), do not clear the flag either, so this is off by
+ * default and turning it on rescans the buffer. Call scan_empty() after
+ * writing the buffer directly while it is on. Bitmap mode only.
+ *
+ * Arguments:
+ *	skip:
+ *		0 to render every row, 1 to skip the empty ones.
+ */
+void TVout::set_skip_empty(char skip) {
+	if (skip)
+		scan_empty();
+	display.skip_empty = skip;
+} // end of set_skip_empty
+
+
+/* set the empty flag of every row from what is in it.
+ * Takes ~hres*vres*4 cycles, ~6k at 128x96.
+ */
+void TVout::scan_empty() {
+	uint8_t y, i;
+	uint8_t * p;
+	
+	if (!display.draw_empty || display.font)
+		return;
+	for (y = 0; y < display.vres; y++) {
+		p = row_addr(y);
+		for (i = 0; i < display.hres && !p[i]; i++);
+		if (i == display.hres)
+			row_cleared(y);
+		else
+			row_used(y);
+	}
+} // end of scan_empty
+
+
+/* show the back buffer.
+ * Waits for the end of the active area and swaps the buffers, the one that
+ * was shown becomes the back buffer with its contents unchanged, screen and
+ * back are swapped to match.
+ * Does nothing without a back buffer.
+ */
+void TVout::flip() {
+	queue_flip();
+	while (display.flip);
+	flipped();
+} // end of flip
+
+
+/* show the back buffer without waiting.
+ * The buffers are swapped at the end of the active area, don't draw until
+ * flipped() returns 1 or the drawing may go to the buffer being shown.
+ */
+void TVout::queue_flip() {
+	if (display.back)
+		display.flip = 1;
+} // end of queue_flip
+
+
+/* check if a flip queued with queue_flip() has happened.
+ * The interrupt swaps the buffers it renders, screen and back follow them
+ * here, they hold the old buffers until this has returned 1.
+ *
+ * Returns:
+ *	1 if the buffers have been swapped, 0 if not yet.
+ */
+char TVout::flipped() {
+	if (display.flip)
+		return 0;
+	if (display.back) {
+		screen = display.screen;
+		back = display.back;
+	}
+	return 1;
+} // end of flipped
+
+
 /* set the vertical blank function call
  * The function passed to this function will be called one per frame. The function should be quickish.
  *
@@ -792,6 +1829,9 @@ void TVout::set_vbi_hook(void (*func)()) {
 /* set the horizonal blank function call
  * This function passed to this function will be called one per scan line.
  * The function MUST be VERY FAST(~2us max).
+ * Installing a hook switches to SCHEDULE_LINE so it really sees every line,
+ * call set_schedule(SCHEDULE_EVENT) afterwards to only run it on the lines
+ * the video generator acts on.
  *
  * Arguments:
  *	funct:
@@ -799,9 +1839,250 @@ void TVout::set_vbi_hook(void (*func)()) {
  */
 void TVout::set_hbi_hook(void (*func)()) {
 	hbi_hook = func;
+	set_schedule(SCHEDULE_LINE);
 } // end of set_bhi_hook
 
 
+/* add a task to run in the vertical blank.
+ * Tasks run one after another with interrupts on from the end of the
+ * active area, through vsync, to the start of the next one, so unlike the
+ * vbi hook they may take longer than a line.
+ * A task only starts if its budget fits before the first active line, the
+ * ones that do not fit run first next frame, so a budget larger than the
+ * whole blank stalls every task after it. A task that runs over its
+ * budget does not corrupt the picture but delays the sketch.
+ * At 16mhz a line is ~1000 cycles, at 96 lines NTSC has ~70 blank lines
+ * (~27 after the active area and ~43 before the next) and PAL ~120.
+ *
+ * Arguments:
+ *	func:
+ *		The function to call once per frame.
+ *	cycles:
+ *		The worst case number of cycles func takes.
+ *
+ * Returns:
+ *	0 if no error.
+ *	1 if MAX_TASKS tasks are already added.
+ */
+char TVout::add_task(void (*func)(), unsigned int cycles) {
+	uint8_t sreg;
+	
+	if (task_count >= MAX_TASKS)
+		return 1;
+	sreg = SREG;
+	cli();
+	tasks[task_count].func = func;
+	tasks[task_count].cycles = cycles;
+	task_count++;
+	SREG = sreg;
+	return 0;
+} // end of add_task
+
+
+/* remove a task added with add_task.
+ * Must not be called from inside a task.
+ *
+ * Arguments:
+ *	func:
+ *		The function to stop calling.
+ */
+void TVout::remove_task(void (*func)()) {
+	uint8_t i, sreg;
+	
+	sreg = SREG;
+	cli();
+	for (i = 0; i < task_count; i++) {
+		if (tasks[i].func == func) {
+			task_count--;
+			for (; i < task_count; i++)
+				tasks[i] = tasks[i+1];
+			break;
+		}
+	}
+	SREG = sreg;
+} // end of remove_task
+
+
+/* show a sprite.
+ * Sprites are 8 pixels wide images in flash, in the format bitmap() takes,
+ * that are ORed or XORed into each line while it is rendered without ever
+ * changing the screen buffer. They go in while the line interrupt waits for
+ * the output start and come out right after the line, so they cost ~30
+ * cycles per sprite and line plus ~60 per sprite and row to look up its
+ * bits, most of which is hidden in time the interrupt would otherwise wait.
+ * Only MAX_SPRITES_LINE sprites are shown on a row, the rest are dropped and
+ * counted by sprite_overflow(). The time left around a line at 16mhz, and
+ * so how many fit, depends on the kernel (estimated, not measured):
+ *	128 wide (6 cycle):	~140 cycles, 1-2 sprites per line.
+ *	160 wide (5 cycle):	~110 cycles, 1 sprite per line.
+ *	184 wide (4 cycle):	~170 cycles, 2-3 sprites per line.
+ *	240 wide (3 cycle):	~190 cycles, 3 sprites per line.
+ * More than that delays the following line and shows up as jitter().
+ * Not available in text mode.
+ *
+ * Arguments:
+ *	n:
+ *		The sprite, 0 to MAX_SPRITES-1.
+ *	image:
+ *		The sprite image, 8 pixels wide.
+ *	x:
+ *		The x coordinate of the left edge.
+ *	y:
+ *		The y coordinate of the top edge.
+ *	mode:
+ *		How the sprite is drawn:
+ *		SPRITE_OR	=1 (default)
+ *		SPRITE_XOR	=2
+ */
+void TVout::set_sprite(uint8_t n, const unsigned char * image, uint8_t x, uint8_t y, uint8_t mode) {
+	uint8_t sreg;
+	
+	if (n >= MAX_SPRITES)
+		return;
+	sreg = SREG;
+	cli();
+	if (!sprites[n].mode && mode)
+		display.sprites++;
+	else if (sprites[n].mode && !mode)
+		display.sprites--;
+	sprites[n].image = image;
+	sprites[n].h = pgm_read_byte(image + 1);
+	sprites[n].x = x;
+	sprites[n].y = y;
+	sprites[n].mode = mode;
+	SREG = sreg;
+} // end of set_sprite
+
+
+/* move a sprite set with set_sprite.
+ *
+ * Arguments:
+ *	n:
+ *		The sprite.
+ *	x:
+ *		The new x coordinate.
+ *	y:
+ *		The new y coordinate.
+ */
+void TVout::move_sprite(uint8_t n, uint8_t x, uint8_t y) {
+	uint8_t sreg;
+	
+	if (n >= MAX_SPRITES)
+		return;
+	sreg = SREG;
+	cli();
+	sprites[n].x = x;
+	sprites[n].y = y;
+	SREG = sreg;
+} // end of move_sprite
+
+
+/* hide a sprite set with set_sprite.
+ *
+ * Arguments:
+ *	n:
+ *		The sprite.
+ */
+void TVout::hide_sprite(uint8_t n) {
+	if (n < MAX_SPRITES)
+		set_sprite(n, sprites[n].image, sprites[n].x, sprites[n].y, SPRITE_OFF);
+} // end of hide_sprite
+
+
+/* Get the number of rows of the last frame that had more than
+ * MAX_SPRITES_LINE sprites on them and dropped some.
+ *
+ * Returns:
+ *	The number of rows.
+ */
+unsigned int TVout::sprite_overflow() {
+	unsigned int n;
+	uint8_t sreg = SREG;
+	
+	cli();
+	n = display.sprite_overflow;
+	SREG = sreg;
+	return n;
+} // end of sprite_overflow
+
+
+/* set which lines run the line handler.
+ * Timer1 still interrupts on every line to keep hsync going, but with
+ * SCHEDULE_EVENT the lines where nothing changes (blank lines and the middle
+ * of vsync) only count themselves and skip hbi_hook and the frame schedule.
+ * An idle line then costs 41 cycles instead of ~130, at 128x96 16mhz:
+ *	NTSC:	~67 idle lines per frame, ~6.0k cycles/frame, ~2.3% of the cpu.
+ *	PAL:	~117 idle lines per frame, ~10.5k cycles/frame, ~3.3% of the cpu.
+ * SCHEDULE_LINE runs the line handler on every line and frees nothing.
+ * The new schedule takes effect on the next line.
+ *
+ * Arguments:
+ *	schedule:
+ *		SCHEDULE_EVENT	=0 (default)
+ *		SCHEDULE_LINE	=1
+ */
+void TVout::set_schedule(uint8_t schedule) {
+	display.schedule = schedule;
+	display.skip = 0;
+} // end of set_schedule
+
+
+/* set a display list to take the rows from.
+ * Each of the vres rows takes hres bytes from its entry's src instead of the
+ * screen buffer, so rows can come from anywhere, other buffers included, and
+ * be repeated or reordered without copying. attr is a combination of:
+ *	LINE_INVERT:	swap black and white, ignored by the 3 cycle kernel.
+ *	LINE_BLANK:		show a black row, src is not read.
+ *	LINE_REPEAT:	take src and attr from the entry above, hscroll and
+ *					sprites still apply to this row.
+ * The drawing functions still draw to the screen buffer.
+ * Takes effect on the next row.
+ *
+ * Arguments:
+ *	list:
+ *		vres entries, or NULL to go back to showing the screen buffer.
+ */
+void TVout::set_display_list(TVout_line * list) {
+	display.list = list;
+} // end of set_display_list
+
+
+/* scroll the picture left without moving the screen buffer.
+ * Whole bytes are skipped when the line is rendered and the rest is made up
+ * by starting the output later, so the edges of the picture move by up to 7
+ * pixels as it scrolls. The bytes past the end of a row come from the start
+ * of the next one, give the rows room with a display list of wider rows to
+ * pan across them.
+ * A row is scrolled by less than its width, so it reads up to x/8 bytes
+ * past its end. The buffers begin() allocates have a zeroed row more for
+ * the last row to read, a buffer passed to begin(), a text attribute
+ * buffer or a display list row needs the same room after it.
+ * Takes effect on the next row.
+ *
+ * Arguments:
+ *	offset:
+ *		The number of pixels to scroll left, at most x-1.
+ */
+void TVout::set_hscroll(uint8_t offset) {
+	if (offset/8 >= display.hres)
+		offset = display.hres*8 - 1;
+	display.hscroll = offset;
+} // end of set_hscroll
+
+
+/* scroll each row left by its own number of pixels, for parallax and wave
+ * effects. See set_hscroll().
+ *
+ * Arguments:
+ *	table:
+ *		vres offsets, one for each row, or NULL to use set_hscroll() again.
+ *		Offsets of x or more are taken as x-1.
+ */
+void TVout::set_hscroll_table(uint8_t * table) {
+	display.hscroll_table = table;
+} // end of set_hscroll_table
+
+
 /* Simple tone generation
  *
  * Arguments:
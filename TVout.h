@@ -36,14 +36,23 @@ application as possible.
 #include <avr/pgmspace.h>
 #include <avr/interrupt.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "video_gen.h"
 #include "spec/hardware_setup.h"
 #include "spec/video_properties.h"
 
+//ENABLE_ROW_TABLE has begin() build a table of where each screen row starts,
+//2*vres bytes of ram, so drawing looks rows up instead of multiplying.
+//#define ENABLE_ROW_TABLE
+
+// 0x80 >> n, defined in TVout.cpp.
+extern const uint8_t pixel_mask[8];
+
 // macros for readability when selecting mode.
 #define PAL						1
 #define	NTSC					0
+#define INTERLACED				_INTERLACED	//or with PAL or NTSC
 #define _PAL					1
 #define _NTSC					0
 
@@ -51,6 +60,14 @@ application as possible.
 #define BLACK					0
 #define INVERT					2
 
+// raster operations for blit(), or in BLIT_PGM when the source is in PROGMEM.
+#define BLIT_COPY				0
+#define BLIT_OR					1
+#define BLIT_AND				2
+#define BLIT_XOR				3
+#define BLIT_ANDNOT				4
+#define BLIT_PGM				0x80
+
 #define UP						0
 #define DOWN					1
 #define LEFT					2
@@ -71,43 +88,76 @@ TVout.cpp contains a brief expenation of each function.
 */
 class TVout {
 public:
-	uint8_t * screen;
+	uint8_t * screen;		//buffer shown, swapped with back by flip()/flipped()
+	uint8_t * back;			//buffer drawn to, NULL when single buffered
 	
 	char begin(uint8_t mode);
 	char begin(uint8_t mode, uint8_t x, uint8_t y);
   char begin(unsigned char *screenBuffer, uint8_t mode, uint8_t x, uint8_t y);
+	char begin(unsigned char *screenBuffer, unsigned char *backBuffer, uint8_t mode, uint8_t x, uint8_t y);
+	char begin_text(uint8_t mode, uint8_t x, uint8_t y, const unsigned char * f, unsigned char * textBuffer = NULL);
+	void set_text_attr(unsigned char * attr);
 	void end();
 	
 	//accessor functions
 	unsigned char hres();
 	unsigned char vres();
 	char char_line();
+	unsigned char jitter();
+#if defined(ENABLE_CPU_STATS)
+	void cpu_stats(TVout_stats * s);
+	void draw_cpu_bar(uint8_t x, uint8_t y, uint8_t w);
+#endif
 	
 	//flow control functions
 	void delay(unsigned int x);
 	void delay_frame(unsigned int x);
+	uint8_t field();
+	void delay_field(uint8_t parity);
 	unsigned long millis();
 	
 	//override setup functions
 	void force_vscale(char sfactor);
+	char set_zones(TVout_zone * zones, uint8_t count);
 	void force_outstart(uint8_t time);
 	void force_linestart(uint8_t line);
+	void set_sleep_sync(char sync);
 	
 	//basic rendering functions
 	void set_pixel(uint8_t x, uint8_t y, char c);
 	unsigned char get_pixel(uint8_t x, uint8_t y);
 	void fill(uint8_t color);
+	void flip();
+	void queue_flip();
+	char flipped();
+	void set_skip_empty(char skip);
+	void scan_empty();
 	void shift(uint8_t distance, uint8_t direction);
 	void draw_line(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1, char c);
 	void draw_row(uint8_t line, uint16_t x0, uint16_t x1, uint8_t c);
 	void draw_column(uint8_t row, uint16_t y0, uint16_t y1, uint8_t c);
 	void draw_rect(uint8_t x0, uint8_t y0, uint8_t w, uint8_t h, char c, char fc = -1); 
 	void draw_circle(uint8_t x0, uint8_t y0, uint8_t radius, char c, char fc = -1);
+	void fill_triangle(int x0, int y0, int x1, int y1, int x2, int y2, char c);
+	void fill_polygon(const int * points, uint8_t n, char c);
 	void bitmap(uint8_t x, uint8_t y, const unsigned char * bmp, uint16_t i = 0, uint8_t width = 0, uint8_t lines = 0);
+	void blit(const unsigned char * src, uint8_t sx, uint8_t sy, uint8_t w, uint8_t h, unsigned char * dst, int dx, int dy, uint8_t rop = BLIT_COPY);
 	
 	//hook setup functions
 	void set_vbi_hook(void (*func)());
 	void set_hbi_hook(void (*func)());
+	void set_schedule(uint8_t schedule);
+	void set_display_list(TVout_line * list);
+	void set_hscroll(uint8_t offset);
+	void set_hscroll_table(uint8_t * table);
+	char add_task(void (*func)(), unsigned int cycles);
+	void remove_task(void (*func)());
+	
+	//sprite functions
+	void set_sprite(uint8_t n, const unsigned char * image, uint8_t x, uint8_t y, uint8_t mode = SPRITE_OR);
+	void move_sprite(uint8_t n, uint8_t x, uint8_t y);
+	void hide_sprite(uint8_t n);
+	unsigned int sprite_overflow();
 
 	//tone functions
 	void tone(unsigned int frequency, unsigned long duration_ms);
@@ -165,7 +215,7 @@ public:
 	void printPGM(const char[]);
 	void printPGM(uint8_t, uint8_t, const char[]);
 	
-private:
+protected:
 	uint8_t cursor_x,cursor_y;
 	const unsigned char * font;
 	
@@ -174,5 +224,112 @@ private:
     void printFloat(double, uint8_t);
 };
 
-static void inline sp(unsigned char x, unsigned char y, char c); 
+/* TVout with the video standard and resolution fixed at compile time.
+ * The screen and the empty row flags are static arrays so nothing is
+ * malloc'd, begin() picks the render kernel at compile time so the other
+ * kernels are not linked in, and set_pixel()/get_pixel() use a constant row
+ * stride. Everything else is TVout. Single buffered bitmap only.
+ *
+ *	TVoutT<NTSC, 128, 96> TV;
+ *	TV.begin();
+ */
+template <uint8_t Standard, uint8_t Width, uint8_t Height>
+class TVoutT : public TVout {
+public:
+	static const uint8_t stride = Width/8;
+	
+	char begin() {
+		cursor_x = 0;
+		cursor_y = 0;
+		screen = buffer;
+		back = NULL;
+		display.font = NULL;
+		display.back = NULL;
+		display.empty = row_empty;
+		display.draw_empty = row_empty;
+		display.skip_empty = 0;
+		render_start(Standard, stride, Height, buffer, KERNEL, CPP);
+		clear_screen();
+		return 0;
+	}
+	
+	// nothing to free.
+	void end() {
+		TIMSK1 = 0;
+		set_sleep_sync(0);
+	}
+	
+	void set_pixel(uint8_t x, uint8_t y, char c) {
+		uint8_t r, bit;
+		uint8_t * p;
+		
+		if (x >= Width || y >= Height)
+			return;
+		r = row_at(y);
+		p = buffer + r*stride + x/8;
+		bit = pixel_mask[x&7];
+		if (c == BLACK) {
+			*p &= ~bit;
+			return;
+		}
+		if (c == WHITE)
+			*p |= bit;
+		else
+			*p ^= bit;
+		row_empty[r/8] &= ~_BV(r&7);
+	}
+	
+	unsigned char get_pixel(uint8_t x, uint8_t y) {
+		if (x >= Width || y >= Height)
+			return 0;
+		return (buffer[row_at(y)*stride + x/8] & pixel_mask[x&7]) ? 1 : 0;
+	}
+	
+private:
+	// the same choice render_setup() makes.
+	static const uint8_t RMETHOD = _CYCLES_ACTIVE/Width;
+	static const bool EXACT = (Width == 32 || Width == 48 || Width == 64 ||
+			Width == 80) && _WIDTH_EXACT(Width);
+	static const uint8_t CPP = EXACT ? RMETHOD : RMETHOD >= 16 ? 16 :
+			RMETHOD >= 12 ? 12 : RMETHOD >= 10 ? 10 : RMETHOD > 8 ? 8 : RMETHOD;
+	static constexpr void (*CPP_KERNEL)() =
+#if defined(UDR_VID)
+			!(CPP & 1) ? &render_line_usart :
+#endif
+			CPP == 16 ? &render_line16c : CPP == 12 ? &render_line12c :
+			CPP == 10 ? &render_line10c : CPP == 8 ? &render_line8c :
+			CPP == 7 ? &render_line7c : CPP == 6 ? &render_line6c :
+			CPP == 5 ? &render_line5c : CPP == 4 ? &render_line4c :
+			&render_line3c;
+	static constexpr void (*KERNEL)() =
+			!EXACT ? CPP_KERNEL : Width == 32 ? &render_line_w32 :
+			Width == 48 ? &render_line_w48 : Width == 64 ? &render_line_w64 :
+			&render_line_w80;
+	
+	static_assert(Width && !(Width & 7), "TVoutT: Width must be a multiple of 8");
+#if defined(UDR_VID)
+	static_assert(CPP >= 2, "TVoutT: Width is too wide for F_CPU");
+#else
+	static_assert(CPP >= _CPP_MIN, "TVoutT: Width is too wide for F_CPU");
+#endif
+	static_assert((Standard & INTERLACED) ||
+			Height <= ((Standard & PAL) ? _PAL_LINE_DISPLAY : _NTSC_LINE_DISPLAY),
+			"TVoutT: Height is too large for the standard");
+	
+	static uint8_t buffer[stride*(Height+1)];	//a row for set_hscroll()
+	static uint8_t row_empty[(Height+7)/8];
+	
+	// row of the ring buffer that row y is in, see row_of().
+	static uint8_t row_at(uint8_t y) {
+		uint16_t r = y + display.draw_origin;
+		
+		return r >= Height ? r - Height : r;
+	}
+};
+
+template <uint8_t Standard, uint8_t Width, uint8_t Height>
+uint8_t TVoutT<Standard, Width, Height>::buffer[TVoutT<Standard, Width, Height>::stride*(Height+1)];
+
+template <uint8_t Standard, uint8_t Width, uint8_t Height>
+uint8_t TVoutT<Standard, Width, Height>::row_empty[(Height+7)/8];
 #endif
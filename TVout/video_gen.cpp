@@ -40,6 +40,7 @@ int renderLine;
 TVout_vid display;
 void (*render_line)();			//remove me
 void (*line_handler)();			//remove me
+field_timing field;
 void (*hbi_hook)() = &empty;
 void (*vbi_hook)() = &empty;
 
@@ -107,6 +108,24 @@ void render_setup(uint8_t mode, uint8_t x, uint8_t y, uint8_t *scrnptr) {
 		display.second_frame_start_render_line = display.lines_frame + display.first_frame_start_render_line;
 		display.second_frame_end_render_line = display.lines_frame + display.first_frame_end_render_line;
 		
+		field.vsync_pulse = 5;
+		field.vsync_equalizing = 10;
+		field.first_vsync_full = 15;
+		field.first_vsync_end = 15;
+		field.second_vsync_full = 14;
+		field.second_vsync_end = 14;
+		field.first_start = _PAL_LINE_FIRSTFRAME_START;
+		field.first_half = _PAL_LINE_FIRSTFRAME_END;
+		field.first_end = _PAL_LINE_FIRSTFRAME_END;
+		field.second_start = _PAL_LINE_SECONDFRAME_START;
+		field.second_half = _PAL_LINE_SECONDFRAME_END - 1;
+		field.second_end = _PAL_LINE_SECONDFRAME_END;
+		field.cycles_scanline = _PAL_CYCLES_SCANLINE;
+		field.cycles_hsync = _PAL_CYCLES_HSYNC_PULSE;
+		field.cycles_vsync_scanline = _PAL_CYCLES_VSYNC_SCANLINE;
+		field.cycles_equalizing = _PAL_CYCLES_VSYNC_EQUALIZING_PULSE;
+		field.cycles_vsync_pulse = _PAL_CYCLES_VSYNC_PULSE;
+		
 		ICR1  = _PAL_CYCLES_VSYNC_SCANLINE;
 		OCR1A = _PAL_CYCLES_VSYNC_EQUALIZING_PULSE;
 	}
@@ -119,6 +138,24 @@ void render_setup(uint8_t mode, uint8_t x, uint8_t y, uint8_t *scrnptr) {
 		display.second_frame_start_render_line = display.lines_frame + display.first_frame_start_render_line;
 		display.second_frame_end_render_line = display.lines_frame + display.first_frame_end_render_line;
 		
+		field.vsync_pulse = 6;
+		field.vsync_equalizing = 12;
+		field.first_vsync_full = 18;
+		field.first_vsync_end = 18;
+		field.second_vsync_full = 17;
+		field.second_vsync_end = 18;
+		field.first_start = _NTSC_LINE_FIRSTFRAME_START;
+		field.first_half = _NTSC_LINE_FIRSTFRAME_END - 1;
+		field.first_end = _NTSC_LINE_FIRSTFRAME_END;
+		field.second_start = _NTSC_LINE_SECONDFRAME_START;
+		field.second_half = _NTSC_LINE_SECONDFRAME_END;
+		field.second_end = _NTSC_LINE_SECONDFRAME_END;
+		field.cycles_scanline = _NTSC_CYCLES_SCANLINE;
+		field.cycles_hsync = _NTSC_CYCLES_HSYNC_PULSE;
+		field.cycles_vsync_scanline = _NTSC_CYCLES_VSYNC_SCANLINE;
+		field.cycles_equalizing = _NTSC_CYCLES_VSYNC_EQUALIZING_PULSE;
+		field.cycles_vsync_pulse = _NTSC_CYCLES_VSYNC_PULSE;
+		
 		ICR1  = _NTSC_CYCLES_VSYNC_SCANLINE;
 		OCR1A = _NTSC_CYCLES_VSYNC_EQUALIZING_PULSE;
 	}
@@ -140,61 +177,35 @@ ISR(TIMER1_OVF_vect) {
 void first_frame_vsync_lines() {
 	display.vsyncScanLine++;
 	
-	if (display.lines_frame == _PAL_LINE_FRAME) {
-		
-		if (display.vsyncScanLine == 5) {
-			OCR1A = _PAL_CYCLES_VSYNC_PULSE;
-		}
-		else if (display.vsyncScanLine == 10) {
-			OCR1A = _PAL_CYCLES_VSYNC_EQUALIZING_PULSE;
-		}
-		else if (display.vsyncScanLine == 15) {
-			ICR1  = _PAL_CYCLES_SCANLINE;
-			OCR1A = _PAL_CYCLES_HSYNC_PULSE;
-		
-			display.scanLine = _PAL_LINE_FIRSTFRAME_START;
-			line_handler = &first_frame_blank_line;
-		}
+	if (display.vsyncScanLine == field.vsync_pulse) {
+		OCR1A = field.cycles_vsync_pulse;
 	}
-	else {
-		if (display.vsyncScanLine == 6) {
-			OCR1A = _NTSC_CYCLES_VSYNC_PULSE;
-		}
-		else if (display.vsyncScanLine == 12) {
-			OCR1A = _NTSC_CYCLES_VSYNC_EQUALIZING_PULSE;
-		}
-		else if (display.vsyncScanLine == 18) {
-			ICR1  = _NTSC_CYCLES_SCANLINE;
-			OCR1A = _NTSC_CYCLES_HSYNC_PULSE;
-
-			display.scanLine = _NTSC_LINE_FIRSTFRAME_START;
-			line_handler = &first_frame_blank_line;
-		}
+	else if (display.vsyncScanLine == field.vsync_equalizing) {
+		OCR1A = field.cycles_equalizing;
+	}
+	
+	if (display.vsyncScanLine == field.first_vsync_full) {
+		ICR1  = field.cycles_scanline;
+	}
+	if (display.vsyncScanLine == field.first_vsync_end) {
+		OCR1A = field.cycles_hsync;
+		
+		display.scanLine = field.first_start;
+		line_handler = &first_frame_blank_line;
 	}
 }
 
 void first_frame_blank_line() {
 	display.scanLine++;
 	
-	if (display.lines_frame == _PAL_LINE_FRAME) {
-		if (display.scanLine == _PAL_LINE_FIRSTFRAME_END) {
-			ICR1  = _PAL_CYCLES_VSYNC_SCANLINE;
-			OCR1A = _PAL_CYCLES_VSYNC_EQUALIZING_PULSE;
-
-			line_handler = &second_frame_vsync_lines;
-			display.vsyncScanLine = 0;
-		}
+	if (display.scanLine == field.first_half) {
+		ICR1  = field.cycles_vsync_scanline;
 	}
-	else {
-		if (display.scanLine == (_NTSC_LINE_FIRSTFRAME_END - 1)) {
-			ICR1  = _NTSC_CYCLES_VSYNC_SCANLINE;
-		}
-		else if (display.scanLine == _NTSC_LINE_FIRSTFRAME_END) {
-			OCR1A = _NTSC_CYCLES_VSYNC_EQUALIZING_PULSE;
+	if (display.scanLine == field.first_end) {
+		OCR1A = field.cycles_equalizing;
 		
-			line_handler = &second_frame_vsync_lines;
-			display.vsyncScanLine = 0;
-		}
+		line_handler = &second_frame_vsync_lines;
+		display.vsyncScanLine = 0;
 	}
 	
 	if (display.scanLine == display.first_frame_start_render_line) {
@@ -240,64 +251,35 @@ void first_frame_active_line() {
 void second_frame_vsync_lines() {
 	display.vsyncScanLine++;
 	
-	if (display.lines_frame == _PAL_LINE_FRAME) {
-		
-		if (display.vsyncScanLine == 5) {
-			OCR1A = _PAL_CYCLES_VSYNC_PULSE;
-		}
-		else if (display.vsyncScanLine == 10) {
-			OCR1A = _PAL_CYCLES_VSYNC_EQUALIZING_PULSE;
-		}
-		else if (display.vsyncScanLine == 14) {
-			ICR1  = _PAL_CYCLES_SCANLINE;
-			OCR1A = _PAL_CYCLES_HSYNC_PULSE;
-		
-			display.scanLine = _PAL_LINE_SECONDFRAME_START;
-			line_handler = &second_frame_blank_line;
-		}
+	if (display.vsyncScanLine == field.vsync_pulse) {
+		OCR1A = field.cycles_vsync_pulse;
 	}
-	else {
-		
-		if (display.vsyncScanLine == 6) {
-			OCR1A = _NTSC_CYCLES_VSYNC_PULSE;
-		}
-		else if (display.vsyncScanLine == 12) {
-			OCR1A = _NTSC_CYCLES_VSYNC_EQUALIZING_PULSE;
-		}
-		else if (display.vsyncScanLine == 17) {
-			ICR1  = _NTSC_CYCLES_SCANLINE;
-		}
-		else if (display.vsyncScanLine == 18) {
-			OCR1A = _NTSC_CYCLES_HSYNC_PULSE;
+	else if (display.vsyncScanLine == field.vsync_equalizing) {
+		OCR1A = field.cycles_equalizing;
+	}
+	
+	if (display.vsyncScanLine == field.second_vsync_full) {
+		ICR1  = field.cycles_scanline;
+	}
+	if (display.vsyncScanLine == field.second_vsync_end) {
+		OCR1A = field.cycles_hsync;
 		
-			display.scanLine = _NTSC_LINE_SECONDFRAME_START;
-			line_handler = &second_frame_blank_line;
-		}
+		display.scanLine = field.second_start;
+		line_handler = &second_frame_blank_line;
 	}
 }
 
 void second_frame_blank_line() {
 	display.scanLine++;
 	
-	if (display.lines_frame == _PAL_LINE_FRAME) {
-		if (display.scanLine == (_PAL_LINE_SECONDFRAME_END - 1)) {
-			ICR1  = _PAL_CYCLES_VSYNC_SCANLINE;
-		}
-		else if (display.scanLine == _PAL_LINE_SECONDFRAME_END) {
-			OCR1A = _PAL_CYCLES_VSYNC_EQUALIZING_PULSE;
-		
-			line_handler = &first_frame_vsync_lines;
-			display.vsyncScanLine = 0;
-		}
+	if (display.scanLine == field.second_half) {
+		ICR1  = field.cycles_vsync_scanline;
 	}
-	else {
-		if (display.scanLine == _NTSC_LINE_SECONDFRAME_END) {
-			ICR1  = _NTSC_CYCLES_VSYNC_SCANLINE;
-			OCR1A = _NTSC_CYCLES_VSYNC_EQUALIZING_PULSE;
+	if (display.scanLine == field.second_end) {
+		OCR1A = field.cycles_equalizing;
 		
-			line_handler = &first_frame_vsync_lines;
-			display.vsyncScanLine = 0;
-		}
+		line_handler = &first_frame_vsync_lines;
+		display.vsyncScanLine = 0;
 	}
 	
 	if (display.scanLine == display.second_frame_start_render_line) {
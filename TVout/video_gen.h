@@ -46,7 +46,30 @@ typedef struct {
 	uint8_t * screen;
 } TVout_vid;
 
+// field timing of the selected standard, filled in once by render_setup()
+// so the line handlers never have to look at the standard again.
+typedef struct {
+	uint8_t vsync_pulse;		//half line of vsync the broad pulses start on
+	uint8_t vsync_equalizing;	//half line the post equalizing pulses start on
+	uint8_t first_vsync_full;	//half line the first field goes back to full lines
+	uint8_t first_vsync_end;	//half line the first field vsync ends on
+	uint8_t second_vsync_full;
+	uint8_t second_vsync_end;
+	int first_start;			//scanLine after the first field vsync
+	int first_half;				//scanLine ICR1 switches to half lines
+	int first_end;				//scanLine the second field vsync starts on
+	int second_start;
+	int second_half;
+	int second_end;
+	uint16_t cycles_scanline;
+	uint16_t cycles_hsync;
+	uint16_t cycles_vsync_scanline;
+	uint16_t cycles_equalizing;
+	uint16_t cycles_vsync_pulse;
+} field_timing;
+
 extern TVout_vid display;
+extern field_timing field;
 
 extern void (*hbi_hook)();
 extern void (*vbi_hook)();
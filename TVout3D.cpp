@@ -0,0 +1,237 @@
+/*
+Copyright (c) 2010 Myles Metzer
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+/*
+Fixed point 3D transform and projection, see TVout3D.h.
+*/
+
+#include <avr/pgmspace.h>
+#include "TVout3D.h"
+
+// 256*sin() of the first quarter turn, 0 to 64 inclusive.
+static const int16_t sine_table[65] PROGMEM = {
+	0, 6, 13, 19, 25, 31, 38, 44, 50, 56, 62, 68, 74,
+	80, 86, 92, 98, 104, 109, 115, 121, 126, 132, 137, 142, 147,
+	152, 157, 162, 167, 172, 177, 181, 185, 190, 194, 198, 202, 206,
+	209, 213, 216, 220, 223, 226, 229, 231, 234, 237, 239, 241, 243,
+	245, 247, 248, 250, 251, 252, 253, 254, 255, 255, 256, 256, 256
+};
+
+// 8.8 product, rounded.
+static inline int16_t fx_mul(int16_t a, int16_t b) {
+	return ((int32_t)a*b + 128) >> 8;
+}
+
+
+/* sine of an angle in 8.8 fixed point.
+ *
+ * Arguments:
+ *	angle:
+ *		0-255 for a full turn, 64 is a right angle.
+ *
+ * Returns:
+ *	-256 to 256.
+ */
+int16_t sin_fx(uint8_t angle) {
+	uint8_t i = angle & 63;
+	int16_t s;
+	
+	if (angle & 64)
+		i = 64 - i;
+	s = pgm_read_word(&sine_table[i]);
+	if (angle & 128)
+		return -s;
+	return s;
+} // end of sin_fx
+
+
+/* cosine of an angle in 8.8 fixed point, see sin_fx().
+ */
+int16_t cos_fx(uint8_t angle) {
+	return sin_fx(angle + 64);
+} // end of cos_fx
+
+
+/* Set a matrix to the identity.
+ */
+void matrix_identity(TVout_matrix * m) {
+	uint8_t i, j;
+	
+	for (i = 0; i < 3; i++)
+		for (j = 0; j < 3; j++)
+			m->m[i][j] = (i == j) ? 256 : 0;
+} // end of matrix_identity
+
+
+/* Set a matrix to a rotation about x, then y, then z.
+ * Build it from the absolute angles every frame rather than multiplying
+ * small steps in, 8.8 errors add up over many multiplies.
+ *
+ * Arguments:
+ *	m:
+ *		The matrix to set.
+ *	ax:
+ *		The angle about the x axis, 0-255 for a full turn.
+ *	ay:
+ *		The angle about the y axis.
+ *	az:
+ *		The angle about the z axis.
+ */
+void matrix_rotate(TVout_matrix * m, uint8_t ax, uint8_t ay, uint8_t az) {
+	int16_t sx = sin_fx(ax), cx = cos_fx(ax);
+	int16_t sy = sin_fx(ay), cy = cos_fx(ay);
+	int16_t sz = sin_fx(az), cz = cos_fx(az);
+	int16_t sysx = fx_mul(sy,sx), sycx = fx_mul(sy,cx);
+	
+	m->m[0][0] = fx_mul(cz,cy);
+	m->m[0][1] = fx_mul(cz,sysx) - fx_mul(sz,cx);
+	m->m[0][2] = fx_mul(cz,sycx) + fx_mul(sz,sx);
+	m->m[1][0] = fx_mul(sz,cy);
+	m->m[1][1] = fx_mul(sz,sysx) + fx_mul(cz,cx);
+	m->m[1][2] = fx_mul(sz,sycx) - fx_mul(cz,sx);
+	m->m[2][0] = -sy;
+	m->m[2][1] = fx_mul(cy,sx);
+	m->m[2][2] = fx_mul(cy,cx);
+} // end of matrix_rotate
+
+
+/* r = a*b, apply b then a. r may be a or b.
+ */
+void matrix_multiply(TVout_matrix * r, const TVout_matrix * a, const TVout_matrix * b) {
+	TVout_matrix t;
+	uint8_t i, j;
+	
+	for (i = 0; i < 3; i++)
+		for (j = 0; j < 3; j++)
+			t.m[i][j] = ((int32_t)a->m[i][0]*b->m[0][j] +
+				(int32_t)a->m[i][1]*b->m[1][j] +
+				(int32_t)a->m[i][2]*b->m[2][j] + 128) >> 8;
+	*r = t;
+} // end of matrix_multiply
+
+
+/* Multiply vertices by a matrix.
+ *
+ * Arguments:
+ *	m:
+ *		The matrix.
+ *	in:
+ *		The vertices, integers.
+ *	out:
+ *		Where to put the result, may be in.
+ *	n:
+ *		The number of vertices.
+ */
+void transform_vertices(const TVout_matrix * m, const TVout_vertex * in, TVout_vertex * out, uint8_t n) {
+	int16_t x, y, z;
+	
+	for (; n; n--, in++, out++) {
+		x = in->x;
+		y = in->y;
+		z = in->z;
+		out->x = ((int32_t)m->m[0][0]*x + (int32_t)m->m[0][1]*y + (int32_t)m->m[0][2]*z + 128) >> 8;
+		out->y = ((int32_t)m->m[1][0]*x + (int32_t)m->m[1][1]*y + (int32_t)m->m[1][2]*z + 128) >> 8;
+		out->z = ((int32_t)m->m[2][0]*x + (int32_t)m->m[2][1]*y + (int32_t)m->m[2][2]*z + 128) >> 8;
+	}
+} // end of transform_vertices
+
+
+/* Perspective project vertices to screen coordinates.
+ * The eye is at z = -zoff looking down +z with the screen view pixels in
+ * front of it. Each vertex takes one division for view/z in 8.8, x and y
+ * are then multiplied by it. y goes down the screen like the vertices.
+ *
+ * Arguments:
+ *	in:
+ *		The vertices.
+ *	out:
+ *		Two bytes per vertex, x,y. OFF_SCREEN,OFF_SCREEN for a vertex
+ *		behind the eye or off the screen.
+ *	n:
+ *		The number of vertices.
+ *	zoff:
+ *		Distance from the eye to z = 0.
+ *	view:
+ *		Distance from the eye to the screen in pixels, the zoom.
+ *	w:
+ *		The width of the screen in pixels, TV.hres().
+ *	h:
+ *		The height of the screen in pixels.
+ *
+ * Returns:
+ *	The number of vertices that are OFF_SCREEN.
+ */
+uint8_t project_vertices(const TVout_vertex * in, uint8_t * out, uint8_t n, int16_t zoff, uint8_t view, uint8_t w, uint8_t h) {
+	int32_t z, r;
+	int16_t x, y;
+	uint8_t off = 0;
+	
+	for (; n; n--, in++, out += 2) {
+		z = (int32_t)in->z + zoff;
+		if (z > 0) {
+			r = (((int32_t)view << 8) + z/2) / z;
+			x = (w/2) + (((int32_t)in->x*r) >> 8);
+			y = (h/2) + (((int32_t)in->y*r) >> 8);
+			if (x >= 0 && x < w && y >= 0 && y < h) {
+				out[0] = x;
+				out[1] = y;
+				continue;
+			}
+		}
+		out[0] = OFF_SCREEN;
+		out[1] = OFF_SCREEN;
+		off++;
+	}
+	return off;
+} // end of project_vertices
+
+
+/* Draw lines between projected vertices.
+ * Edges with an end OFF_SCREEN are left out.
+ *
+ * Arguments:
+ *	tv:
+ *		The TVout to draw on.
+ *	points:
+ *		Screen coordinates from project_vertices().
+ *	edges:
+ *		Pairs of vertex numbers in PROGMEM, two bytes per edge.
+ *	n:
+ *		The number of edges.
+ *	c:
+ *		The color of the lines.
+ *		(see color note at the top of TVout.cpp)
+ */
+void draw_edges(TVout & tv, const uint8_t * points, const uint8_t * edges, uint8_t n, char c) {
+	const uint8_t * a;
+	const uint8_t * b;
+	
+	for (; n; n--, edges += 2) {
+		a = points + 2*pgm_read_byte(edges);
+		b = points + 2*pgm_read_byte(edges + 1);
+		if (a[0] == OFF_SCREEN || b[0] == OFF_SCREEN)
+			continue;
+		tv.draw_line(a[0], a[1], b[0], b[1], c);
+	}
+} // end of draw_edges
@@ -0,0 +1,63 @@
+/*
+Copyright (c) 2010 Myles Metzer
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+/*
+Fixed point 3D for wireframe scenes.
+Angles are 0-255 for a full turn, sines and matrix entries are 8.8 fixed
+point (256 is 1.0) and products are summed in 16.16 before going back to
+8.8, so a frame needs no floating point and one division per vertex.
+
+	TVout_matrix m;
+	matrix_rotate(&m, ax, ay, az);
+	transform_vertices(&m, model, world, 8);
+	project_vertices(world, screen, 8, 150, 64, TV.hres(), TV.vres());
+	draw_edges(TV, screen, edges, 12, WHITE);
+*/
+#ifndef TVOUT3D_H
+#define TVOUT3D_H
+
+#include "TVout.h"
+
+// screen coordinate of a vertex that is behind the eye or off the screen.
+#define OFF_SCREEN	255
+
+typedef struct {
+	int16_t x,y,z;
+} TVout_vertex;
+
+typedef struct {
+	int16_t m[3][3];	//8.8, row major
+} TVout_matrix;
+
+int16_t sin_fx(uint8_t angle);
+int16_t cos_fx(uint8_t angle);
+
+void matrix_identity(TVout_matrix * m);
+void matrix_rotate(TVout_matrix * m, uint8_t ax, uint8_t ay, uint8_t az);
+void matrix_multiply(TVout_matrix * r, const TVout_matrix * a, const TVout_matrix * b);
+void transform_vertices(const TVout_matrix * m, const TVout_vertex * in, TVout_vertex * out, uint8_t n);
+uint8_t project_vertices(const TVout_vertex * in, uint8_t * out, uint8_t n, int16_t zoff, uint8_t view, uint8_t w, uint8_t h);
+void draw_edges(TVout & tv, const uint8_t * points, const uint8_t * edges, uint8_t n, char c);
+
+#endif
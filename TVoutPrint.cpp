@@ -34,6 +34,11 @@ void TVout::select_font(const unsigned char * f) {
  */
 void TVout::print_char(uint8_t x, uint8_t y, unsigned char c) {
 
+	// text mode only stores the character
+	if (display.font) {
+		display.draw[(y/8)*display.hres + x/8] = c;
+		return;
+	}
 	c -= pgm_read_byte(font+2);
 	bitmap(x,y,font,(c*pgm_read_byte(font+1))+3,pgm_read_byte(font),pgm_read_byte(font+1));
 }
@@ -0,0 +1,159 @@
+#include <TVout.h>
+#include <TVout3D.h>
+#include <fontALL.h>
+
+// Build once as is and once with ENABLE_ROW_TABLE defined in TVout.h to
+// compare the drawing rates.
+
+TVout TV;
+
+// loop iterations the sketch gets in about a second, more is more cpu.
+unsigned long spin() {
+  volatile unsigned long n = 0;
+  unsigned long stop;
+
+  TV.delay_frame(1);
+  stop = TV.millis() + 1000;
+  while (TV.millis() < stop)
+    n++;
+  return n;
+}
+
+// line pairs drawn in about a second, a steep one of 96 pixels and a
+// shallow one of 128.
+unsigned long lines() {
+  unsigned long n = 0;
+  unsigned long stop;
+
+  TV.delay_frame(1);
+  stop = TV.millis() + 1000;
+  while (TV.millis() < stop) {
+    TV.draw_line(16, 0, 111, 95, INVERT);
+    TV.draw_line(0, 40, 127, 56, INVERT);
+    n++;
+  }
+  return n;
+}
+
+// circles of radius 40 drawn in about a second.
+unsigned long circles() {
+  unsigned long n = 0;
+  unsigned long stop;
+
+  TV.delay_frame(1);
+  stop = TV.millis() + 1000;
+  while (TV.millis() < stop) {
+    TV.draw_circle(64, 48, 40, INVERT);
+    n++;
+  }
+  return n;
+}
+
+// filled triangles of 64 by 64 drawn in about a second.
+unsigned long triangles() {
+  unsigned long n = 0;
+  unsigned long stop;
+
+  TV.delay_frame(1);
+  stop = TV.millis() + 1000;
+  while (TV.millis() < stop) {
+    TV.fill_triangle(32, 16, 96, 48, 40, 80, INVERT);
+    n++;
+  }
+  return n;
+}
+
+// vertices rotated and projected in about a second, a new matrix per
+// batch of 8 like a spinning cube. 0 if the origin does not project on
+// screen, the width or height given is wrong.
+unsigned long vertices() {
+  TVout_vertex model[8], world[8];
+  TVout_vertex origin = {0, 0, 0};
+  uint8_t screen[8][2];
+  TVout_matrix m;
+  unsigned long n = 0;
+  unsigned long stop;
+  uint8_t a = 0;
+
+  if (project_vertices(&origin, screen[0], 1, 150, 64, TV.hres(), TV.vres()))
+    return 0;
+  for (uint8_t i = 0; i < 8; i++) {
+    model[i].x = (i & 1) ? 40 : -40;
+    model[i].y = (i & 2) ? 40 : -40;
+    model[i].z = (i & 4) ? 40 : -40;
+  }
+  TV.delay_frame(1);
+  stop = TV.millis() + 1000;
+  while (TV.millis() < stop) {
+    matrix_rotate(&m, a, a, a);
+    transform_vertices(&m, model, world, 8);
+    project_vertices(world, screen[0], 8, 150, 64, TV.hres(), TV.vres());
+    a++;
+    n += 8;
+  }
+  return n;
+}
+
+// pixels in one circle of radius 40.
+unsigned int circle_pixels() {
+  unsigned int n = 0;
+
+  TV.clear_screen();
+  TV.draw_circle(64, 48, 40, WHITE);
+  for (uint8_t y = 8; y <= 88; y++)
+    for (uint8_t x = 24; x <= 104; x++)
+      n += TV.get_pixel(x, y);
+  return n;
+}
+
+void setup() {
+  unsigned long all, skip, l, c, t, v;
+  unsigned int cp;
+
+  TV.begin(NTSC,128,96);
+  TV.select_font(font6x8);
+
+  // a typical text screen, a few lines of text and the rest black.
+  TV.println("TVout benchmark");
+  TV.println("");
+  TV.println("empty row skip");
+  TV.println("");
+
+  TV.set_skip_empty(0);
+  all = spin();
+  TV.set_skip_empty(1);
+  skip = spin();
+
+  l = lines();
+  c = circles();
+  t = triangles();
+  v = vertices();
+  cp = circle_pixels();
+
+  TV.clear_screen();
+  TV.println("TVout benchmark");
+  TV.println("");
+  TV.print("all:  ");
+  TV.println(all);
+  TV.print("skip: ");
+  TV.println(skip);
+  TV.print("gain: ");
+  TV.print((skip - all) * 100 / all);
+  TV.println("%");
+  TV.println("");
+  TV.println("pixels/s");
+  TV.print("line:   ");
+  TV.println(l * 224);
+  TV.print("circle: ");
+  TV.println(c * cp);
+  TV.print("triangle/s: ");
+  TV.println(t);
+  TV.print("vertex/frame: ");
+  if (v)
+    TV.println(v / 60);
+  else
+    TV.println("origin off screen");
+}
+
+void loop() {
+}
@@ -1,4 +1,5 @@
 #include <TVout.h>
+#include <TVout3D.h>
 #include <fontALL.h>
 #include "schematic.h"
 #include "TVOlogo.h"
@@ -6,23 +7,26 @@
 TVout TV;
 
 int zOff = 150;
-int xOff = 0;
-int yOff = 0;
-int cSize = 50;
+const int cSize = 50;
 int view_plane = 64;
-float angle = PI/60;
+uint8_t angle = 2; //256 is a full turn
+uint8_t ax, ay, az;
 
-float cube3d[8][3] = {
-  {xOff - cSize,yOff + cSize,zOff - cSize},
-  {xOff + cSize,yOff + cSize,zOff - cSize},
-  {xOff - cSize,yOff - cSize,zOff - cSize},
-  {xOff + cSize,yOff - cSize,zOff - cSize},
-  {xOff - cSize,yOff + cSize,zOff + cSize},
-  {xOff + cSize,yOff + cSize,zOff + cSize},
-  {xOff - cSize,yOff - cSize,zOff + cSize},
-  {xOff + cSize,yOff - cSize,zOff + cSize}
+TVout_vertex cube3d[8] = {
+  {-cSize, cSize,-cSize},
+  { cSize, cSize,-cSize},
+  {-cSize,-cSize,-cSize},
+  { cSize,-cSize,-cSize},
+  {-cSize, cSize, cSize},
+  { cSize, cSize, cSize},
+  {-cSize,-cSize, cSize},
+  { cSize,-cSize, cSize}
 };
+TVout_vertex world[8];
 unsigned char cube2d[8][2];
+const unsigned char cube_edges[12][2] PROGMEM = {
+  {0,1},{0,2},{0,4},{1,5},{1,3},{2,6},{2,3},{4,6},{4,5},{7,6},{7,3},{7,5}
+};
 
 
 void setup() {
@@ -91,37 +95,37 @@ void loop() {
   switch(random(6)) {
     case 0:
       for (int i = 0; i < rsteps; i++) {
-        zrotate(angle);
+        az += angle;
         printcube();
       }
       break;
     case 1:
       for (int i = 0; i < rsteps; i++) {
-        zrotate(2*PI - angle);
+        az -= angle;
         printcube();
       }
       break;
     case 2:
       for (int i = 0; i < rsteps; i++) {
-        xrotate(angle);
+        ax += angle;
         printcube();
       }
       break;
     case 3:
       for (int i = 0; i < rsteps; i++) {
-        xrotate(2*PI - angle);
+        ax -= angle;
         printcube();
       }
       break;
     case 4:
       for (int i = 0; i < rsteps; i++) {
-        yrotate(angle);
+        ay += angle;
         printcube();
       }
       break;
     case 5:
       for (int i = 0; i < rsteps; i++) {
-        yrotate(2*PI - angle);
+        ay -= angle;
         printcube();
       }
       break;
@@ -152,66 +156,13 @@ unsigned char w,l,wb;
 }
 
 void printcube() {
+  TVout_matrix m;
+
   //calculate 2d points
-  for(byte i = 0; i < 8; i++) {
-    cube2d[i][0] = (unsigned char)((cube3d[i][0] * view_plane / cube3d[i][2]) + (TV.hres()/2));
-    cube2d[i][1] = (unsigned char)((cube3d[i][1] * view_plane / cube3d[i][2]) + (TV.vres()/2));
-  }
+  matrix_rotate(&m, ax, ay, az);
+  transform_vertices(&m, cube3d, world, 8);
+  project_vertices(world, cube2d[0], 8, zOff, view_plane, TV.hres(), TV.vres());
   TV.delay_frame(1);
   TV.clear_screen();
-  draw_cube();
+  draw_edges(TV, cube2d[0], cube_edges[0], 12, WHITE);
 }
-
-void zrotate(float q) {
-  float tx,ty,temp;
-  for(byte i = 0; i < 8; i++) {
-    tx = cube3d[i][0] - xOff;
-    ty = cube3d[i][1] - yOff;
-    temp = tx * cos(q) - ty * sin(q);
-    ty = tx * sin(q) + ty * cos(q);
-    tx = temp;
-    cube3d[i][0] = tx + xOff;
-    cube3d[i][1] = ty + yOff;
-  }
-}
-
-void yrotate(float q) {
-  float tx,tz,temp;
-  for(byte i = 0; i < 8; i++) {
-    tx = cube3d[i][0] - xOff;
-    tz = cube3d[i][2] - zOff;
-    temp = tz * cos(q) - tx * sin(q);
-    tx = tz * sin(q) + tx * cos(q);
-    tz = temp;
-    cube3d[i][0] = tx + xOff;
-    cube3d[i][2] = tz + zOff;
-  }
-}
-
-void xrotate(float q) {
-  float ty,tz,temp;
-  for(byte i = 0; i < 8; i++) {
-    ty = cube3d[i][1] - yOff;
-    tz = cube3d[i][2] - zOff;
-    temp = ty * cos(q) - tz * sin(q);
-    tz = ty * sin(q) + tz * cos(q);
-    ty = temp;
-    cube3d[i][1] = ty + yOff;
-    cube3d[i][2] = tz + zOff;
-  }
-}
-
-void draw_cube() {
-  TV.draw_line(cube2d[0][0],cube2d[0][1],cube2d[1][0],cube2d[1][1],WHITE);
-  TV.draw_line(cube2d[0][0],cube2d[0][1],cube2d[2][0],cube2d[2][1],WHITE);
-  TV.draw_line(cube2d[0][0],cube2d[0][1],cube2d[4][0],cube2d[4][1],WHITE);
-  TV.draw_line(cube2d[1][0],cube2d[1][1],cube2d[5][0],cube2d[5][1],WHITE);
-  TV.draw_line(cube2d[1][0],cube2d[1][1],cube2d[3][0],cube2d[3][1],WHITE);
-  TV.draw_line(cube2d[2][0],cube2d[2][1],cube2d[6][0],cube2d[6][1],WHITE);
-  TV.draw_line(cube2d[2][0],cube2d[2][1],cube2d[3][0],cube2d[3][1],WHITE);
-  TV.draw_line(cube2d[4][0],cube2d[4][1],cube2d[6][0],cube2d[6][1],WHITE);
-  TV.draw_line(cube2d[4][0],cube2d[4][1],cube2d[5][0],cube2d[5][1],WHITE);
-  TV.draw_line(cube2d[7][0],cube2d[7][1],cube2d[6][0],cube2d[6][1],WHITE);
-  TV.draw_line(cube2d[7][0],cube2d[7][1],cube2d[3][0],cube2d[3][1],WHITE);
-  TV.draw_line(cube2d[7][0],cube2d[7][1],cube2d[5][0],cube2d[5][1],WHITE);
-}
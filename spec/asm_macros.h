@@ -28,6 +28,13 @@
 #ifndef ASM_MACROS_H
 #define ASM_MACROS_H
 
+// long jump when the part has one
+#if defined(__AVR_HAVE_JMP_CALL__)
+#define XJMP	"jmp"
+#else
+#define XJMP	"rjmp"
+#endif
+
 // delay macros
 __asm__ __volatile__ (
 	// delay 1 clock cycle.
@@ -124,6 +131,13 @@ __asm__ __volatile__ (
 		"nop\n\t"
 		"nop\n"
 	".endm\n"
+	
+	// delay n clock cycles, n can be an expression and may be 0
+	".macro delayn n\n\t"
+		".rept \\n\n\t"
+		"nop\n\t"
+		".endr\n"
+	".endm\n"
 ); // end of delay macros
 
 // common output macros, specific output macros at top of file
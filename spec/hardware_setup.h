@@ -30,6 +30,14 @@
 //comment out this line to switch back to the original output pins.
 #define ENABLE_FAST_OUTPUT
 
+//ENABLE_USART_OUTPUT shifts the pixels out of the usart in spi master mode
+//instead, video then comes out of the TXD pin below and XCK toggles with the
+//pixel clock. Lets render_setup() pick 2 cycle pixels (up to 248 wide, the
+//most begin()'s uint8_t x can ask for). This buys resolution only, the
+//kernel still polls the usart for the whole line so no cpu time is freed.
+//On a 168/328 this is the Serial/pollserial usart.
+//#define ENABLE_USART_OUTPUT
+
 #ifndef HARDWARE_SETUP_H
 #define HARDWARE_SETUP_H
 
@@ -130,6 +138,56 @@
 #define WGM21		WGM01
 #endif
 
+// usart used for ENABLE_USART_OUTPUT, not every part can do it.
+#if defined(ENABLE_USART_OUTPUT)
+#if defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__)
+//usart1, leaves Serial alone
+#define UDR_VID		UDR1
+#define UCSRA_VID	UCSR1A
+#define UCSRB_VID	UCSR1B
+#define UCSRC_VID	UCSR1C
+#define UBRR_VID	UBRR1
+#define UDRE_VID	UDRE1
+#define TXEN_VID	TXEN1
+#define UMSEL_VID	(_BV(UMSEL11) | _BV(UMSEL10))
+#define PORT_TXD	PORTD
+#define DDR_TXD		DDRD
+#define TXD_PIN		3
+#define DDR_XCK		DDRD
+#define XCK_PIN		5
+#elif defined(__AVR_ATmega644P__) || defined(__AVR_ATmega1284__) || defined(__AVR_ATmega1284P__) || defined(__AVR_ATmega88__) || defined(__AVR_ATmega168P__) || defined(__AVR_ATmega168__) || defined(__AVR_ATmega328P__) || defined(__AVR_ATmega328__)
+#define UDR_VID		UDR0
+#define UCSRA_VID	UCSR0A
+#define UCSRB_VID	UCSR0B
+#define UCSRC_VID	UCSR0C
+#define UBRR_VID	UBRR0
+#define UDRE_VID	UDRE0
+#define TXEN_VID	TXEN0
+#define UMSEL_VID	(_BV(UMSEL01) | _BV(UMSEL00))
+#define PORT_TXD	PORTD
+#define DDR_TXD		DDRD
+#define TXD_PIN		1
+#if defined(__AVR_ATmega644P__) || defined(__AVR_ATmega1284__) || defined(__AVR_ATmega1284P__)
+#define DDR_XCK		DDRB
+#define XCK_PIN		0
+#else
+#define DDR_XCK		DDRD
+#define XCK_PIN		4
+#endif
+#endif
+#endif
+
+//render_line3c and the 4 cycle text kernel write the whole port with the
+//pixels on bit 7, the other kernels work on any pin and leave the rest of
+//the port alone.
+#if VID_PIN == 7
+#define _CPP_MIN		3
+#define _CPP_MIN_TEXT	4
+#else
+#define _CPP_MIN		4
+#define _CPP_MIN_TEXT	6
+#endif
+
 //automatic BST/BLD/ANDI macro definition
 #if VID_PIN == 0
 #define BLD_HWS		"bld	r16,0\n\t"
@@ -37,6 +37,16 @@
 #define _TIME_ACTIVE				46
 #define _CYCLES_VIRT_SYNC			((_TIME_VIRT_SYNC * _CYCLES_PER_US) - 1)
 #define _CYCLES_HORZ_SYNC			((_TIME_HORZ_SYNC * _CYCLES_PER_US) - 1)
+#define _CYCLES_ACTIVE				(_TIME_ACTIVE * _CYCLES_PER_US)
+
+//widest line in bytes at 3 cycles per pixel, render_line3c is unrolled to it
+#define _HRES_MAX					(_CYCLES_ACTIVE/24)
+
+//the exact width kernels of w pixels need the 6 cycle fetch between bytes
+#define _WIDTH_EXACT(w)				(_CYCLES_ACTIVE/(w) >= 6)
+
+//cycles before the output start a sleep synchronized active line wakes up
+#define _CYCLES_SYNC_WAKE			48
 
 //Timing settings for NTSC
 #define _NTSC_TIME_SCANLINE			63.55
@@ -25,47 +25,141 @@
 
 #include <avr/interrupt.h>
 #include <avr/io.h>
+#include <avr/sleep.h>
+#include <avr/pgmspace.h>
 
 #include "video_gen.h"
 #include "spec/video_properties.h"
 #include "spec/asm_macros.h"
 #include "spec/hardware_setup.h"
 
+//#define REMOVEWIDTHS
+//#define REMOVE16C
+//#define REMOVE12C
+//#define REMOVE10C
+//#define REMOVE8C
+//#define REMOVE7C
 //#define REMOVE6C
 //#define REMOVE5C
 //#define REMOVE4C
 //#define REMOVE3C
 
+#if defined(ENABLE_CPU_STATS)
+// fixed costs the cpu stats cannot sample, see the line interrupt entry.
+#if defined(__AVR_3_BYTE_PC__)
+#define _CYCLES_IDLE_LINE		43
+#else
+#define _CYCLES_IDLE_LINE		41
+#endif
+#define _CYCLES_DISPATCH_EXIT	35
+
+TVout_stats frame_stats;
+static TVout_stats stats;
+#endif
+
 int renderLine;
+static uint8_t renderRow;
+static uint8_t renderPhys;		//row of screen at renderLine
+static uint8_t zone;			//index in display.zones
+static uint8_t zone_rows;		//rows left in it
+static uint8_t no_attr;			//text attributes when there are none
+static uint8_t * row_src;		//line_src before hscroll, kept for LINE_REPEAT
+static uint8_t * row_end;		//first byte after the row being rendered
+
+TVout_sprite sprites[MAX_SPRITES];
+
+// a sprite row patched into the line source around render_line().
+typedef struct {
+	uint8_t * p;
+	uint8_t * q;			//p + 1, or patch_pad at the end of a row
+	uint8_t mode;
+	uint8_t a, b;			//bits for *p and *q
+	uint8_t save_a, save_b;
+} sprite_patch;
+
+static sprite_patch patches[MAX_SPRITES_LINE];
+static uint8_t patch_count;
+// stands in for the byte after a row so a patch never saves and restores
+// memory past the end of the buffer, which another interrupt may write
+// while a sleep synchronized line waits.
+static uint8_t patch_pad;
 TVout_vid display;
 void (*render_line)();			//remove me
-void (*line_handler)();			//remove me
+TVout_event frame_events[MAX_EVENTS];
 void (*hbi_hook)() = &empty;
 void (*vbi_hook)() = &empty;
 
+TVout_task tasks[MAX_TASKS];
+uint8_t task_count;
+static uint8_t next_task;			//where the last frame stopped
+static volatile uint8_t task_state;	//TASKS_*
+#define TASKS_IDLE		0
+#define TASKS_PENDING	1
+#define TASKS_RUNNING	2
+
+// left free before the first active line for the line interrupts that
+// happen while the last task returns.
+#define _CYCLES_TASK_SLACK	200
+
 // sound properties
 volatile long remainingToneVsyncs;
 
 void empty() {}
 
-void render_setup(uint8_t mode, uint8_t x, uint8_t y, uint8_t *scrnptr) {
+#if defined(UDR_VID)
+/* Put the usart in spi master mode shifting a pixel every cpp cycles.
+ * The transmitter is only enabled during active video, the rest of the time
+ * TXD is a low port pin.
+ */
+static void usart_setup(uint8_t cpp) {
+	UBRR_VID = 0;
+	PORT_TXD &= ~_BV(TXD_PIN);
+	DDR_TXD |= _BV(TXD_PIN);
+	DDR_XCK |= _BV(XCK_PIN);
+	UCSRC_VID = UMSEL_VID;	//msb first, like the screen
+	UCSRB_VID = _BV(TXEN_VID);
+	UBRR_VID = cpp/2 - 1;	//must follow TXEN
+	UCSRB_VID = 0;
+}
+#endif
 
-	display.screen = scrnptr;
-	display.hres = x;
-	display.vres = y;
-	display.frames = 0;
+void render_setup(uint8_t mode, uint8_t x, uint8_t y, uint8_t *scrnptr) {
+	uint8_t cpp;
 	
-	if (mode)
-		display.vscale_const = _PAL_LINE_DISPLAY/display.vres - 1;
+	//selects the widest render method that fits in 46us, at any clock
+	//low resolutions get wide pixels to fill the screen
+	unsigned char rmethod = _CYCLES_ACTIVE/(x*8);
+	if (rmethod >= 16)
+		rmethod = 16;
+	else if (rmethod >= 12)
+		rmethod = 12;
+	else if (rmethod >= 10)
+		rmethod = 10;
+	else if (rmethod > 8)
+		rmethod = 8;
+#if defined(UDR_VID)
+	// the usart shifts a pixel every even number of cycles, the odd widths
+	// stay with the bit banged kernels.
+	if (!display.font && !(rmethod & 1))
+		render_line = &render_line_usart;
 	else
-		display.vscale_const = _NTSC_LINE_DISPLAY/display.vres - 1;
-	display.vscale = display.vscale_const;
-	
-	//selects the widest render method that fits in 46us
-	//as of 9/16/10 rendermode 3 will not work for resolutions lower than
-	//192(display.hres lower than 24)
-	unsigned char rmethod = (_TIME_ACTIVE*_CYCLES_PER_US)/(display.hres*8);
+#endif
 	switch(rmethod) {
+		case 16:
+			render_line = &render_line16c;
+			break;
+		case 12:
+			render_line = &render_line12c;
+			break;
+		case 10:
+			render_line = &render_line10c;
+			break;
+		case 8:
+			render_line = &render_line8c;
+			break;
+		case 7:
+			render_line = &render_line7c;
+			break;
 		case 6:
 			render_line = &render_line6c;
 			break;
@@ -79,13 +173,92 @@ void render_setup(uint8_t mode, uint8_t x, uint8_t y, uint8_t *scrnptr) {
 			render_line = &render_line3c;
 			break;
 		default:
-			if (rmethod > 6)
-				render_line = &render_line6c;
-			else
-				render_line = &render_line3c;
+			render_line = &render_line3c;
 	}
+	cpp = rmethod < 3 ? 3 : rmethod;
+#if defined(UDR_VID)
+	if (render_line == &render_line_usart && rmethod < 3)
+		cpp = 2;
+#endif
 	
+	// the standard low resolutions have kernels of their exact width, the
+	// nearest of 16, 12, 10 or 8 cycles can leave a third of the line black.
+	// A clock too slow for one keeps the kernel picked above.
+#ifndef REMOVEWIDTHS
+	switch (x*8) {
+#if _WIDTH_EXACT(32)
+		case 32:
+			render_line = &render_line_w32;
+			cpp = _CYCLES_ACTIVE/32;
+			break;
+#endif
+#if _WIDTH_EXACT(48)
+		case 48:
+			render_line = &render_line_w48;
+			cpp = _CYCLES_ACTIVE/48;
+			break;
+#endif
+#if _WIDTH_EXACT(64)
+		case 64:
+			render_line = &render_line_w64;
+			cpp = _CYCLES_ACTIVE/64;
+			break;
+#endif
+#if _WIDTH_EXACT(80)
+		case 80:
+			render_line = &render_line_w80;
+			cpp = _CYCLES_ACTIVE/80;
+			break;
+#endif
+	}
+#endif
+	
+	// text mode needs the gaps of the 4 and 6 cycle kernels for the lookup.
+	if (display.font) {
+		if (rmethod >= 6 || _CPP_MIN_TEXT == 6) {
+			render_line = &render_line_text6c;
+			cpp = 6;
+		}
+		else {
+			render_line = &render_line_text4c;
+			cpp = 4;
+		}
+	}
+	
+	render_start(mode, x, y, scrnptr, render_line, cpp);
+}
 
+/* Start the video with the kernel already picked, render_setup() picks it at
+ * run time and TVoutT at compile time, so a TVoutT sketch does not link the
+ * kernels it never uses.
+ */
+void render_start(uint8_t mode, uint8_t x, uint8_t y, uint8_t *scrnptr, void (*line)(), uint8_t cpp) {
+	render_line = line;
+	display.cpp = cpp;
+#if defined(UDR_VID)
+	if (line == &render_line_usart)
+		usart_setup(cpp);
+#endif
+	display.screen = scrnptr;
+	display.hres = x;
+	display.vres = y;
+	display.frames = 0;
+	display.origin = 0;
+	display.draw = scrnptr;
+	display.draw_origin = 0;
+	display.flip = 0;
+	display.zones = 0;
+	display.interlace = (mode & _INTERLACED) ? 1 : 0;
+	display.field = 0;
+	
+	// an interlaced field only has half the rows to fit.
+	y = (y + display.interlace) >> display.interlace;
+	if (mode & 1)
+		display.vscale_const = _PAL_LINE_DISPLAY/y - 1;
+	else
+		display.vscale_const = _NTSC_LINE_DISPLAY/y - 1;
+	display.vscale = display.vscale_const;
+	
 	DDR_VID |= _BV(VID_PIN);
 	DDR_SYNC |= _BV(SYNC_PIN);
 	PORT_VID &= ~_BV(VID_PIN);
@@ -96,8 +269,8 @@ void render_setup(uint8_t mode, uint8_t x, uint8_t y, uint8_t *scrnptr) {
 	TCCR1A = _BV(COM1A1) | _BV(COM1A0) | _BV(WGM11);
 	TCCR1B = _BV(WGM13) | _BV(WGM12) | _BV(CS10);
 	
-	if (mode) {
-		display.start_render = _PAL_LINE_MID - ((display.vres * (display.vscale_const+1))/2);
+	if (mode & 1) {
+		display.start_render = _PAL_LINE_MID - render_lines()/2;
 		display.output_delay = _PAL_CYCLES_OUTPUT_START;
 		display.vsync_end = _PAL_LINE_STOP_VSYNC;
 		display.lines_frame = _PAL_LINE_FRAME;
@@ -105,61 +278,263 @@ void render_setup(uint8_t mode, uint8_t x, uint8_t y, uint8_t *scrnptr) {
 		OCR1A = _CYCLES_HORZ_SYNC;
 		}
 	else {
-		display.start_render = _NTSC_LINE_MID - ((display.vres * (display.vscale_const+1))/2) + 8;
+		display.start_render = _NTSC_LINE_MID - render_lines()/2 + 8;
 		display.output_delay = _NTSC_CYCLES_OUTPUT_START;
 		display.vsync_end = _NTSC_LINE_STOP_VSYNC;
 		display.lines_frame = _NTSC_LINE_FRAME;
 		ICR1 = _NTSC_CYCLES_SCANLINE;
 		OCR1A = _CYCLES_HORZ_SYNC;
 	}
-	display.scanLine = display.lines_frame+1;
-	line_handler = &vsync_line;
+	OCR1B = display.output_delay - _CYCLES_SYNC_WAKE;
+	display.entry_min = 0xff;
+	display.scanLine = 0;
+	display.render = 0;
+	schedule_setup();
 	TIMSK1 = _BV(TOIE1);
 	sei();
 }
 
-// render a line
-ISR(TIMER1_OVF_vect) {
-	hbi_hook();
-	line_handler();
+// add an event to the frame schedule, events landing on or before the line
+// of the previous one are merged into it so the table is always ascending.
+static void add_event(uint8_t *i, int line, uint16_t ocr1a, uint16_t icr1, uint8_t action) {
+	TVout_event * e = &frame_events[*i];
+	
+	if (*i && line <= e[-1].line) {
+		e--;
+		e->action |= action;
+		if (ocr1a)
+			e->ocr1a = ocr1a;
+		if (icr1)
+			e->icr1 = icr1;
+		return;
+	}
+	e->line = line;
+	e->ocr1a = ocr1a;
+	e->icr1 = icr1;
+	e->action = action;
+	(*i)++;
 }
 
-void blank_line() {
-		
-	if ( display.scanLine == display.start_render) {
-		renderLine = 0;
-		display.vscale = display.vscale_const;
-		line_handler = &active_line;
+/* Number of lines the screen takes up in a field.
+ */
+int render_lines() {
+	int lines = 0;
+	uint8_t i;
+	
+	if (!display.zones)
+		return ((display.vres + display.interlace) >> display.interlace)*(display.vscale_const+1);
+	for (i = 0; i < display.zone_count; i++)
+		lines += display.zones[i].rows*display.zones[i].vscale;
+	return lines;
+}
+
+/* Build the per frame line schedule from the current display settings.
+ * Called by render_setup() and again whenever start_render or vscale_const
+ * change. Everything the ISR does that is not rendering a line happens on
+ * one of these lines.
+ *
+ * Interlaced, every field is half a line shorter than a progressive frame,
+ * 262.5 lines NTSC and 312.5 PAL. The odd field ends on a half line so the
+ * even field's vsync starts in the middle of a line, the even field takes a
+ * half line right after its vsync to get hsync back in step. Lines of the
+ * even field then sit half a line higher than the same lines of the odd
+ * one, between the odd field's rows.
+ */
+void schedule_setup() {
+	uint8_t i = 0;
+	int end_render = display.start_render + render_lines();
+	uint16_t scanline = display.lines_frame == _PAL_LINE_FRAME ?
+			_PAL_CYCLES_SCANLINE : _NTSC_CYCLES_SCANLINE;
+	uint8_t sreg = SREG;
+	
+	if (end_render > display.lines_frame - 1)
+		end_render = display.lines_frame - 1;
+	
+	cli();
+	if (display.interlace) {
+		add_event(&i, 0, _CYCLES_VIRT_SYNC, scanline, EVENT_FRAME);
+		add_event(&i, display.vsync_end, _CYCLES_HORZ_SYNC, 0, 0);
+		add_event(&i, display.vsync_end + 1, 0, 0, EVENT_HALF_EVEN);
+		add_event(&i, display.vsync_end + 2, 0, scanline, 0);
 	}
-	else if (display.scanLine == display.lines_frame) {
-		line_handler = &vsync_line;
-		vbi_hook();
+	else {
+		add_event(&i, 0, _CYCLES_VIRT_SYNC, 0, EVENT_FRAME);
+		add_event(&i, display.vsync_end, _CYCLES_HORZ_SYNC, 0, 0);
 	}
+	add_event(&i, display.start_render + 1, 0, 0, EVENT_RENDER_ON);
+	add_event(&i, end_render + 1, 0, 0, EVENT_RENDER_OFF);
+	add_event(&i, display.lines_frame, 0, 0, EVENT_VBI | EVENT_WRAP |
+			(display.interlace ? EVENT_HALF_ODD : 0));
 	
-	display.scanLine++;
+	// pick up at the first event still ahead in the current frame.
+	display.event = 0;
+	while (frame_events[display.event].line < display.scanLine &&
+			!(frame_events[display.event].action & EVENT_WRAP))
+		display.event++;
+	display.next_event = frame_events[display.event].line;
+	display.skip = 0;
+	SREG = sreg;
 }
 
-void active_line() {
-	wait_until(display.output_delay);
-	render_line();
-	if (!display.vscale) {
-		display.vscale = display.vscale_const;
-		renderLine += display.hres;
+// work out which sprite bits go into the row at renderRow.
+static void inline sprite_row() {
+	TVout_sprite * s;
+	sprite_patch * p = patches;
+	uint8_t dy, i;
+	uint16_t bits;
+	uint8_t * b;
+	
+	patch_count = 0;
+	for (i = 0; i < MAX_SPRITES; i++) {
+		s = &sprites[i];
+		dy = renderRow - s->y;
+		// hscroll moves line_src on, a sprite can land past the end of
+		// the row, in the next one or past the buffer. It is not shown there.
+		b = display.line_src + s->x/8;
+		if (!s->mode || dy >= s->h || s->x/8 >= display.hres || b >= row_end)
+			continue;
+		if (patch_count == MAX_SPRITES_LINE) {
+			display.sprite_drops++;
+			return;
+		}
+		bits = (uint16_t)pgm_read_byte(s->image + 2 + dy) << 8;
+		bits >>= s->x & 7;
+		p->p = b;
+		p->q = b + 1 < row_end ? b + 1 : &patch_pad;
+		p->mode = s->mode;
+		p->a = bits >> 8;
+		p->b = bits;
+		p++;
+		patch_count++;
+	}
+}
+
+// find the source and attributes of the row at renderRow.
+static void inline row_start() {
+	TVout_line * l;
+	uint8_t scroll;
+	uint16_t delay;
+	
+	if (display.list) {
+		l = &display.list[renderRow];
+		// a repeated row keeps the source and attributes of the one above,
+		// its scroll, sprites and glyph row are still its own.
+		if (!(l->attr & LINE_REPEAT) || !renderRow) {
+			row_src = l->src;
+			display.line_attr = l->attr;
+			display.line_inv = (l->attr & LINE_INVERT) ? 0xff : 0;
+		}
+		display.line_src = row_src;
 	}
+	else {
+		display.line_src = display.screen + renderLine;
+		display.line_attr = 0;
+		display.line_inv = 0;
+	}
+	
+	row_end = display.line_src + display.hres;
+	
+	// scrolling left by a part of a byte starts a byte further on, later.
+	scroll = display.hscroll_table ? display.hscroll_table[renderRow] : display.hscroll;
+	if (scroll/8 >= display.hres)	//less than a row, the padding is one row
+		scroll = display.hres*8 - 1;
+	display.line_src += scroll/8;
+	delay = display.output_delay;
+	if (scroll & 7) {
+		display.line_src++;
+		delay += (8 - (scroll & 7))*display.cpp;
+	}
+	display.line_delay = delay > 255 ? 255 : delay;	//wait_until() is 8 bit
+	
+	if (display.sprites && !display.font)
+		sprite_row();
 	else
-		display.vscale--;
-		
-	if ((display.scanLine + 1) == (int)(display.start_render + (display.vres*(display.vscale_const+1))))
-		line_handler = &blank_line;
-		
-	display.scanLine++;
+		patch_count = 0;
+	
+	// an empty row with no sprites on it is just black.
+	if (display.skip_empty && display.empty && !display.list && !display.font &&
+			!patch_count && (display.empty[renderPhys/8] & _BV(renderPhys&7)))
+		display.line_attr = LINE_BLANK;
+	
+	if (display.font) {
+		display.glyph = display.font + (renderRow & 7);
+		if (display.attr)
+			display.attr_src = display.attr + (display.line_src - display.screen);
+		else
+			display.attr_src = &no_attr;
+	}
 }
 
-void vsync_line() {
-	if (display.scanLine >= display.lines_frame) {
-		OCR1A = _CYCLES_VIRT_SYNC;
-		display.scanLine = 0;
+// apply the event scheduled for this line and queue the next one.
+static void inline frame_event() {
+	TVout_event * e = &frame_events[display.event];
+	uint8_t action = e->action;
+	
+	if (e->ocr1a)
+		OCR1A = e->ocr1a;
+	if (e->icr1)
+		ICR1 = e->icr1;
+	if (action & (display.field ? EVENT_HALF_ODD : EVENT_HALF_EVEN))
+		ICR1 >>= 1;
+	
+	if (action & EVENT_RENDER_ON) {
+		// the odd field starts on the second row.
+		renderPhys = display.origin;
+		renderRow = display.field;
+		if (renderRow && !display.font && ++renderPhys >= display.vres)
+			renderPhys = 0;
+		renderLine = renderPhys*display.hres;
+		row_start();
+		if (display.zones) {
+			zone = 0;
+			zone_rows = display.zones[0].rows;
+			display.vscale = display.zones[0].vscale - 1;
+		}
+		else
+			display.vscale = display.vscale_const;
+		display.render = 1;
+	}
+	else if (action & EVENT_RENDER_OFF) {
+		display.render = 0;
+		if (display.flip) {
+			uint8_t origin = display.origin;
+			uint8_t * empty = display.empty;
+			
+			display.draw = display.screen;
+			display.screen = display.back;
+			display.back = display.draw;
+			display.empty = display.draw_empty;
+			display.draw_empty = empty;
+			display.origin = display.draw_origin;
+			display.draw_origin = origin;
+			display.flip = 0;
+		}
+	}
+	
+	if (action & EVENT_FRAME) {
 		display.frames++;
+		if (display.interlace)
+			display.field ^= 1;
+		display.jitter = display.entry_max - display.entry_min;
+		display.sprite_overflow = display.sprite_drops;
+		display.sprite_drops = 0;
+		display.entry_min = 0xff;
+		display.entry_max = 0;
+#if defined(ENABLE_CPU_STATS)
+		stats.frame_cycles = (unsigned long)(display.lines_frame + 1) * (ICR1 + 1);
+		stats.idle_lines = display.lines_frame + 1 - stats.idle_lines;
+		stats.isr_cycles += (unsigned long)stats.idle_lines * _CYCLES_IDLE_LINE;
+		if (stats.late_lines)
+			stats.missed_frames++;
+		frame_stats = stats;
+		stats.isr_cycles = 0;
+		stats.active_cycles = 0;
+		stats.blank_cycles = 0;
+		stats.hook_cycles = 0;
+		stats.idle_lines = 0;	// counts dispatched lines until the next frame
+		stats.worst_line = 0;
+		stats.late_lines = 0;
+#endif
 
 		if (remainingToneVsyncs != 0)
 		{
@@ -173,13 +548,242 @@ void vsync_line() {
 			TCCR2B = 0; //stop the tone
  			PORTB &= ~(_BV(SND_PIN));
 		}
+	}
+	
+	if ((action & EVENT_VBI) && vbi_hook != &empty) {
+#if defined(ENABLE_CPU_STATS)
+		uint16_t t = TCNT1;
+		vbi_hook();
+		stats.hook_cycles += TCNT1 - t;
+#else
+		vbi_hook();
+#endif
+	}
+	if ((action & EVENT_RENDER_OFF) && task_count && task_state == TASKS_IDLE)
+		task_state = TASKS_PENDING;
+	
+	if (action & EVENT_WRAP) {
+		display.event = 0;
+		display.scanLine = -1;	// the increment after this line starts the frame on 0
+	}
+	else
+		display.event++;
+	display.next_event = frame_events[display.event].line;
+}
+
+/* Line interrupt entry.
+ * Timer1 has to keep overflowing every line to generate hsync, so idle lines
+ * still interrupt. While display.skip is non zero the line is only counted
+ * here, saving r24, r25 and SREG, everything else goes on to line_dispatch().
+ *
+ * Cycle counts at 16mhz on a 2 byte PC part (3 byte PC parts add 2),
+ * including the interrupt response and vector jump:
+ *	idle line:		41 cycles, +0-3 finishing the interrupted instruction.
+ *	other lines:	25 cycles of entry before line_dispatch(), whose
+ *					prologue and epilogue add ~70 more. On active lines this
+ *					is hidden by wait_until(), the first pixel still goes out
+ *					output_delay cycles after the start of the line.
+ */
+ISR(TIMER1_OVF_vect, ISR_NAKED) {
+	__asm__ __volatile__ (
+		"push	r24\n\t"						//2
+		"in		r24,__SREG__\n\t"			//1
+		"push	r24\n\t"						//2
+		"lds	r24,%[skip]\n\t"				//2
+		"subi	r24,1\n\t"					//1
+		"brcs	1f\n\t"						//1 (2 taken)
+		"sts	%[skip],r24\n\t"				//2
+		"push	r25\n\t"						//2
+		"lds	r24,%[line]\n\t"				//2
+		"lds	r25,%[line]+1\n\t"			//2
+		"adiw	r24,1\n\t"					//2
+		"sts	%[line]+1,r25\n\t"			//2
+		"sts	%[line],r24\n\t"				//2
+		"pop	r25\n\t"						//2
+		"pop	r24\n\t"						//2
+		"out	__SREG__,r24\n\t"			//1
+		"pop	r24\n\t"						//2
+		"reti\n"							//4
+	"1:\n\t"
+		"pop	r24\n\t"						//2
+		"out	__SREG__,r24\n\t"			//1
+		"pop	r24\n\t"						//2
+		XJMP "	__vector_line_dispatch\n\t"	//3
+		:
+		: [skip] "i" (&display.skip),
+		[line] "i" (&display.scanLine)
+	);
+}
 
+/* Everything but counting idle lines, entered from the line interrupt with
+ * all registers as they were in the interrupted code.
+ */
+/* Run the vbi tasks until the blank lines run out.
+ * Tasks start on the render off line and run with interrupts on, the line
+ * interrupt nests on top of them and keeps counting, through the wrap, up
+ * to the first active line of the next frame. Before each task the cycles
+ * left until that line are worked out from scanLine and TCNT1, a task whose
+ * budget does not fit waits for the next frame and starts it.
+ */
+static void run_tasks() {
+	uint8_t n = task_count;
+	int lines;
+	long left;
+	
+	task_state = TASKS_RUNNING;
+	while (n--) {
+		if (next_task >= task_count)
+			next_task = 0;
+		lines = display.start_render + 1 - display.scanLine;
+		if (lines < 0)	//still before the wrap
+			lines += display.lines_frame + 1;
+		left = (long)lines * (ICR1 + 1) + ICR1 - TCNT1;
+		if (TIFR1 & _BV(TOV1))
+			left -= ICR1 + 1;
+		if (left < (long)tasks[next_task].cycles + _CYCLES_TASK_SLACK)
+			break;
+		sei();
+		tasks[next_task].func();
+		cli();
+		next_task++;
 	}
-	else if (display.scanLine == display.vsync_end) {
-		OCR1A = _CYCLES_HORZ_SYNC;
-		line_handler = &blank_line;
+	task_state = TASKS_IDLE;
+} // end of run_tasks
+
+void line_dispatch() {
+#if defined(ENABLE_CPU_STATS)
+	uint16_t t;
+#endif
+	if (display.scanLine == display.next_event)
+		frame_event();
+	if (hbi_hook != &empty) {
+#if defined(ENABLE_CPU_STATS)
+		t = TCNT1;
+		hbi_hook();
+		stats.hook_cycles += TCNT1 - t;
+#else
+		hbi_hook();
+#endif
 	}
+	if (display.render)
+		active_line();
 	display.scanLine++;
+	
+	// the lines up to the next event can be counted by the entry alone.
+	if (display.render || display.schedule == SCHEDULE_LINE)
+		display.skip = 0;
+	else if (display.next_event - display.scanLine > 255)
+		display.skip = 255;
+	else
+		display.skip = display.next_event - display.scanLine;
+	
+#if defined(ENABLE_CPU_STATS)
+	// the line started when TCNT1 wrapped, so it is also the time spent.
+	t = TCNT1 + _CYCLES_DISPATCH_EXIT;
+	stats.isr_cycles += t;
+	if (display.render)
+		stats.active_cycles += t;
+	else
+		stats.blank_cycles += t;
+	if (t > stats.worst_line)
+		stats.worst_line = t;
+	if (TIFR1 & _BV(TOV1))
+		stats.late_lines++;
+	stats.idle_lines++;
+#endif
+	
+	if (task_state == TASKS_PENDING)
+		run_tasks();
+}
+
+// only wakes the cpu for a sleep synchronized active line.
+EMPTY_INTERRUPT(TIMER1_COMPB_vect);
+
+void active_line() {
+	uint8_t entry;
+	sprite_patch * p;
+	uint8_t i;
+	
+	// sprites go in while the line waits for its output start and come out
+	// right after it, so the sketch never sees them. Interrupts serviced
+	// while a sleep synchronized line waits do, they must not draw to the
+	// rows sprites are on. Patching after the wake up would cost cycles the
+	// wake up margin does not have.
+	for (i = 0, p = patches; i < patch_count; i++, p++) {
+		p->save_a = *p->p;
+		p->save_b = *p->q;
+		if (p->mode == SPRITE_OR) {
+			*p->p |= p->a;
+			*p->q |= p->b;
+		}
+		else {
+			*p->p ^= p->a;
+			*p->q ^= p->b;
+		}
+	}
+	
+	// Sleeping until OCR1B makes the wake up, and everything after it, take
+	// the same number of cycles every line no matter what the interrupted
+	// code was doing. Other interrupts may wake the cpu first, they just get
+	// serviced and the cpu goes back to sleep.
+	if (display.sleep_sync && TCNT1 < OCR1B) {
+		TIFR1 = _BV(OCF1B);
+		TIMSK1 |= _BV(OCIE1B);
+		do {
+			sei();
+			sleep_cpu();
+			cli();
+		} while (TCNT1 < OCR1B);
+		TIMSK1 &= ~_BV(OCIE1B);
+	}
+	
+	// everything up to wait_until() is hidden by it, so the entry time
+	// statistic is free.
+	entry = TCNT1L;
+	if (entry < display.entry_min)
+		display.entry_min = entry;
+	if (entry > display.entry_max)
+		display.entry_max = entry;
+	
+	wait_until(display.line_delay);
+	if (!(display.line_attr & LINE_BLANK))
+		render_line();
+	// last patch first, two patches can share a byte and the later one
+	// saved it with the earlier one's bits in.
+	for (i = patch_count, p = patches + patch_count; i--; ) {
+		p--;
+		*p->q = p->save_b;
+		*p->p = p->save_a;
+	}
+	if (!display.vscale) {
+		uint8_t step = display.interlace + 1;
+		
+		if (display.zones) {
+			if (!--zone_rows && zone + 1 < display.zone_count)
+				zone_rows = display.zones[++zone].rows;
+			display.vscale = display.zones[zone].vscale - 1;
+		}
+		else
+			display.vscale = display.vscale_const;
+		// a text row is 8 screen rows high, a field skips every other row.
+		do {
+			if (!display.font) {
+				renderLine += display.hres;
+				renderPhys++;
+				if (renderLine >= display.hres*display.vres) {
+					renderLine = 0;
+					renderPhys = 0;
+				}
+			}
+			else if ((renderRow & 7) == 7)
+				renderLine += display.hres;
+			renderRow++;
+		} while (--step);
+		if (renderRow < display.vres)
+			row_start();
+	}
+	else
+		display.vscale--;
 }
 
 
@@ -204,44 +808,159 @@ static void inline wait_until(uint8_t time) {
 	);
 }
 
-void render_line6c() {
-	#ifndef REMOVE6C
+/* Kernel generators.
+ * The padding between two outs is worked out by the assembler from n, so
+ * every pixel is exactly n cycles wide whatever F_CPU is. The 4 and 5 cycle
+ * kernels are written out by hand, they have to fetch a byte ahead.
+ * RENDER_LINE_SAFE(n) leaves the other pins of the port alone, bst/bld/out
+ * is 3 cycles a pixel and the fetch between bytes needs 6.
+ * RENDER_LINE_CPP(name, n) is the same kernel for an n worked out by the
+ * compiler, the exact width kernels use it.
+ */
+#define RENDER_LINE_SAFE(n)	RENDER_LINE_CPP(render_line##n##c, n)
+
+#define RENDER_LINE_CPP(name, n)								\
+void name() {												\
+	static_assert((n) >= 6, #name ": fewer than 6 cycles a pixel");	\
+	__asm__ __volatile__ (									\
+		"svprt	%[port]\n\t"								\
+		"rjmp	2f\n"										\
+	"1:\n\t"												\
+		"delayn	%[cpp]-6\n\t"								\
+		"bst	__tmp_reg__,0\n\t"							\
+		"o1bs	%[port]\n"									\
+	"2:\n\t"												\
+		"LD		__tmp_reg__,X+\n\t"							\
+		"eor	__tmp_reg__,%[inv]\n\t"						\
+		"delayn	%[cpp]-6\n\t"								\
+		"bst	__tmp_reg__,7\n\t"							\
+		"o1bs	%[port]\n\t"								\
+		".irp	b,6,5,4,3,2,1\n\t"							\
+		"delayn	%[cpp]-3\n\t"								\
+		"bst	__tmp_reg__,\\b\n\t"						\
+		"o1bs	%[port]\n\t"								\
+		".endr\n\t"											\
+		"dec	%[hres]\n\t"								\
+		"brne	1b\n\t"										\
+		"delayn	%[cpp]-5\n\t"								\
+		"bst	__tmp_reg__,0\n\t"							\
+		"o1bs	%[port]\n\t"								\
+		"delayn	%[cpp]-5\n\t"								\
+		"svprt	%[port]\n\t"								\
+		BST_HWS												\
+		"o1bs	%[port]\n\t"								\
+		:													\
+		: [port] "i" (_SFR_IO_ADDR(PORT_VID)),				\
+		"x" (display.line_src),								\
+		[inv] "r" (display.line_inv),						\
+		[hres] "d" (display.hres),							\
+		[cpp] "i" ((uint8_t)(n))								\
+		: "r16"												\
+	);														\
+}
+
+// 32, 48, 64 and 80 pixel modes, pixels as wide as fills the active area
+#if !defined(REMOVEWIDTHS) && _WIDTH_EXACT(32)
+RENDER_LINE_CPP(render_line_w32, _CYCLES_ACTIVE/32)
+#else
+void render_line_w32() {}
+#endif
+
+#if !defined(REMOVEWIDTHS) && _WIDTH_EXACT(48)
+RENDER_LINE_CPP(render_line_w48, _CYCLES_ACTIVE/48)
+#else
+void render_line_w48() {}
+#endif
+
+#if !defined(REMOVEWIDTHS) && _WIDTH_EXACT(64)
+RENDER_LINE_CPP(render_line_w64, _CYCLES_ACTIVE/64)
+#else
+void render_line_w64() {}
+#endif
+
+#if !defined(REMOVEWIDTHS) && _WIDTH_EXACT(80)
+RENDER_LINE_CPP(render_line_w80, _CYCLES_ACTIVE/80)
+#else
+void render_line_w80() {}
+#endif
+
+// wide pixels for the other low resolutions
+#ifndef REMOVE16C
+RENDER_LINE_SAFE(16)
+#else
+void render_line16c() {}
+#endif
+
+#ifndef REMOVE12C
+RENDER_LINE_SAFE(12)
+#else
+void render_line12c() {}
+#endif
+
+#ifndef REMOVE10C
+RENDER_LINE_SAFE(10)
+#else
+void render_line10c() {}
+#endif
+
+#ifndef REMOVE8C
+RENDER_LINE_SAFE(8)
+#else
+void render_line8c() {}
+#endif
+
+#ifndef REMOVE7C
+RENDER_LINE_SAFE(7)
+#else
+void render_line7c() {}
+#endif
+
+#ifndef REMOVE6C
+RENDER_LINE_SAFE(6)
+#else
+void render_line6c() {}
+#endif
+
+void render_line5c() {
+	#ifndef REMOVE5C
 	__asm__ __volatile__ (
-		"ADD	r26,r28\n\t"
-		"ADC	r27,r29\n\t"
 		//save PORTB
 		"svprt	%[port]\n\t"
+		//no room to invert between bytes, fetch one byte ahead instead
+		"LD		r17,X+\n\t"
+		"eor	r17,%[inv]\n\t"
 		
-		"rjmp	enter6\n"
-	"loop6:\n\t"
+		"rjmp	enter5\n"
+	"loop5:\n\t"
 		"bst	__tmp_reg__,0\n\t"			//8
 		"o1bs	%[port]\n"
-	"enter6:\n\t"
-		"LD		__tmp_reg__,X+\n\t"			//1
+	"enter5:\n\t"
+		"mov	__tmp_reg__,r17\n\t"		//1
 		"delay1\n\t"
 		"bst	__tmp_reg__,7\n\t"
 		"o1bs	%[port]\n\t"
-		"delay3\n\t"						//2
+		"LD		r17,X+\n\t"				//2
 		"bst	__tmp_reg__,6\n\t"
 		"o1bs	%[port]\n\t"
-		"delay3\n\t"						//3
+		"eor	r17,%[inv]\n\t"
+		"delay1\n\t"						//3
 		"bst	__tmp_reg__,5\n\t"
 		"o1bs	%[port]\n\t"
-		"delay3\n\t"						//4
+		"delay2\n\t"						//4
 		"bst	__tmp_reg__,4\n\t"
 		"o1bs	%[port]\n\t"
-		"delay3\n\t"						//5
+		"delay2\n\t"						//5
 		"bst	__tmp_reg__,3\n\t"
 		"o1bs	%[port]\n\t"
-		"delay3\n\t"						//6
+		"delay2\n\t"						//6
 		"bst	__tmp_reg__,2\n\t"
 		"o1bs	%[port]\n\t"
-		"delay3\n\t"						//7
+		"delay1\n\t"						//7
+		"dec	%[hres]\n\t"
 		"bst	__tmp_reg__,1\n\t"
 		"o1bs	%[port]\n\t"
-		"dec	%[hres]\n\t"
-		"brne	loop6\n\t"					//go too loopsix
-		"delay2\n\t"
+		"brne	loop5\n\t"					//go too loop5
+		"delay1\n\t"
 		"bst	__tmp_reg__,0\n\t"			//8
 		"o1bs	%[port]\n"
 		
@@ -250,221 +969,293 @@ void render_line6c() {
 		"o1bs	%[port]\n\t"
 		:
 		: [port] "i" (_SFR_IO_ADDR(PORT_VID)),
-		"x" (display.screen),
-		"y" (renderLine),
+		"x" (display.line_src),
+		[inv] "r" (display.line_inv),
 		[hres] "d" (display.hres)
-		: "r16" // try to remove this clobber later...
+		: "r16", "r17" // try to remove this clobber later...
 	);
 	#endif
 }
 
-void render_line5c() {
-	#ifndef REMOVE5C
+/* Port safe at 4 cycles.
+ * bst/bld/out leaves one cycle a pixel, too little for the 2 cycle fetch and
+ * branch. Two shadows of the port take turns, r16 for the even pixels and
+ * r18 for the odd ones, so a pixel can be put in its shadow while the one
+ * before it is still going out and the spare cycles gather where the fetch
+ * and branch need them.
+ */
+void render_line4c() {
+	#ifndef REMOVE4C
 	__asm__ __volatile__ (
-		"ADD	r26,r28\n\t"
-		"ADC	r27,r29\n\t"
-		//save PORTB
 		"svprt	%[port]\n\t"
-		
-		"rjmp	enter5\n"
-	"loop5:\n\t"
-		"bst	__tmp_reg__,0\n\t"			//8
-		"o1bs	%[port]\n"
-	"enter5:\n\t"
-		"LD		__tmp_reg__,X+\n\t"			//1
-		"bst	__tmp_reg__,7\n\t"
-		"o1bs	%[port]\n\t"
-		"delay2\n\t"						//2
+		"mov	r18,r16\n\t"
+		"LD		r17,X+\n\t"
+		"eor	r17,%[inv]\n\t"
+		"bst	r17,7\n"
+	"loop4:\n\t"
+		"bld	r16,%[pin]\n\t"
+		"out	%[port],r16\n\t"			//1
+		"mov	__tmp_reg__,r17\n\t"
 		"bst	__tmp_reg__,6\n\t"
-		"o1bs	%[port]\n\t"
-		"delay2\n\t"						//3
+		"bld	r18,%[pin]\n\t"
+		"out	%[port],r18\n\t"			//2
 		"bst	__tmp_reg__,5\n\t"
-		"o1bs	%[port]\n\t"
-		"delay2\n\t"						//4
+		"bld	r16,%[pin]\n\t"
 		"bst	__tmp_reg__,4\n\t"
-		"o1bs	%[port]\n\t"
-		"delay2\n\t"						//5
+		"out	%[port],r16\n\t"			//3
+		"bld	r18,%[pin]\n\t"
+		"LD		r17,X+\n\t"
+		"out	%[port],r18\n\t"			//4
 		"bst	__tmp_reg__,3\n\t"
-		"o1bs	%[port]\n\t"
-		"delay2\n\t"						//6
+		"bld	r16,%[pin]\n\t"
 		"bst	__tmp_reg__,2\n\t"
-		"o1bs	%[port]\n\t"
-		"delay1\n\t"						//7
+		"out	%[port],r16\n\t"			//5
+		"bld	r18,%[pin]\n\t"
+		"eor	r17,%[inv]\n\t"
 		"dec	%[hres]\n\t"
+		"out	%[port],r18\n\t"			//6
 		"bst	__tmp_reg__,1\n\t"
+		"bld	r16,%[pin]\n\t"
+		"bst	__tmp_reg__,0\n\t"
+		"out	%[port],r16\n\t"			//7
+		"bld	r18,%[pin]\n\t"
+		"bst	r17,7\n\t"				//first pixel of the next byte
+		"delay1\n\t"
+		"out	%[port],r18\n\t"			//8
+		"brne	loop4\n\t"
+		"clt\n\t"
+		"bld	r16,%[pin]\n\t"
+		"out	%[port],r16\n\t"
+		:
+		: [port] "i" (_SFR_IO_ADDR(PORT_VID)),
+		[pin] "i" (VID_PIN),
+		"x" (display.line_src),
+		[inv] "r" (display.line_inv),
+		[hres] "d" (display.hres)
+		: "r16", "r17", "r18"
+	);
+	#endif
+}
+
+/* Text mode kernels.
+ * The line source holds character codes, each byte is looked up in the font
+ * at the glyph row of the current screen row while the previous one is
+ * going out: char*8 + glyph row + font is one mul and a 16 bit add, then lpm.
+ */
+void render_line_text6c() {
+	uint8_t * src = display.line_src;
+	uint8_t * attr = display.attr_src;
+	uint8_t hres = display.hres;
+	
+	__asm__ __volatile__ (
+		"svprt	%[port]\n\t"
+		//fetch the first glyph byte
+		"LD		r19,X+\n\t"
+		"LD		r20,Y\n\t"
+		"add	r28,%[astep]\n\t"
+		"adc	r29,__zero_reg__\n\t"
+		"mul	r19,%[eight]\n\t"
+		"add	r0,%A[glyph]\n\t"
+		"adc	r1,%B[glyph]\n\t"
+		"movw	r30,r0\n\t"
+		"clr	__zero_reg__\n\t"
+		"lpm	r18,Z\n\t"
+		"eor	r18,r20\n\t"
+		"eor	r18,%[inv]\n\t"
+		
+		"rjmp	entert6\n"
+	"loopt6:\n\t"
+		"bst	r17,0\n\t"					//8
+		"o1bs	%[port]\n"
+	"entert6:\n\t"
+		"mov	r17,r18\n\t"				//1
+		"delay2\n\t"
+		"bst	r17,7\n\t"
 		"o1bs	%[port]\n\t"
-		"brne	loop5\n\t"					//go too loop5
+		"LD		r20,Y\n\t"					//2
+		"add	r28,%[astep]\n\t"
+		"bst	r17,6\n\t"
+		"o1bs	%[port]\n\t"
+		"adc	r29,__zero_reg__\n\t"		//3
+		"LD		r19,X+\n\t"
+		"bst	r17,5\n\t"
+		"o1bs	%[port]\n\t"
+		"mul	r19,%[eight]\n\t"			//4
+		"add	r0,%A[glyph]\n\t"
+		"bst	r17,4\n\t"
+		"o1bs	%[port]\n\t"
+		"adc	r1,%B[glyph]\n\t"			//5
+		"movw	r30,r0\n\t"
+		"clr	__zero_reg__\n\t"
+		"bst	r17,3\n\t"
+		"o1bs	%[port]\n\t"
+		"lpm	r18,Z\n\t"					//6
+		"bst	r17,2\n\t"
+		"o1bs	%[port]\n\t"
+		"eor	r18,r20\n\t"				//7
+		"eor	r18,%[inv]\n\t"
 		"delay1\n\t"
-		"bst	__tmp_reg__,0\n\t"			//8
+		"bst	r17,1\n\t"
+		"o1bs	%[port]\n\t"
+		"dec	%[hres]\n\t"
+		"brne	loopt6\n\t"
+		"delay2\n\t"
+		"bst	r17,0\n\t"					//8
 		"o1bs	%[port]\n"
 		
 		"svprt	%[port]\n\t"
 		BST_HWS
 		"o1bs	%[port]\n\t"
-		:
+		: "+x" (src),
+		"+y" (attr),
+		[hres] "+d" (hres)
 		: [port] "i" (_SFR_IO_ADDR(PORT_VID)),
-		"x" (display.screen),
-		"y" (renderLine),
-		[hres] "d" (display.hres)
-		: "r16" // try to remove this clobber later...
+		[glyph] "r" (display.glyph),
+		[eight] "r" ((uint8_t)8),
+		[astep] "r" ((uint8_t)(display.attr ? 1 : 0)),
+		[inv] "r" (display.line_inv)
+		: "r16", "r17", "r18", "r19", "r20", "r30", "r31"
 	);
-	#endif
 }
 
-void render_line4c() {
-	#ifndef REMOVE4C
+// no attributes, the lpm takes all of the gap between two bytes.
+void render_line_text4c() {
+	uint8_t * src = display.line_src;
+	uint8_t hres = display.hres;
+	
 	__asm__ __volatile__ (
-		"ADD	r26,r28\n\t"
-		"ADC	r27,r29\n\t"
+		//address of the first glyph byte
+		"LD		r19,X+\n\t"
+		"mul	r19,%[eight]\n\t"
+		"add	r0,%A[glyph]\n\t"
+		"adc	r1,%B[glyph]\n\t"
+		"movw	r30,r0\n\t"
+		"clr	__zero_reg__\n\t"
 		
-		"rjmp	enter4\n"
-	"loop4:\n\t"
-		"lsl	__tmp_reg__\n\t"			//8
-		"out	%[port],__tmp_reg__\n\t"
-	"enter4:\n\t"
-		"LD		__tmp_reg__,X+\n\t"			//1
-		"delay1\n\t"
-		"out	%[port],__tmp_reg__\n\t"
-		"delay2\n\t"						//2
-		"lsl	__tmp_reg__\n\t"
-		"out	%[port],__tmp_reg__\n\t"
-		"delay2\n\t"						//3
-		"lsl	__tmp_reg__\n\t"
-		"out	%[port],__tmp_reg__\n\t"
-		"delay2\n\t"						//4
-		"lsl	__tmp_reg__\n\t"
-		"out	%[port],__tmp_reg__\n\t"
-		"delay2\n\t"						//5
-		"lsl	__tmp_reg__\n\t"
-		"out	%[port],__tmp_reg__\n\t"
+		"rjmp	entert4\n"
+	"loopt4:\n\t"
+		"lsl	r17\n\t"					//8
+		"out	%[port],r17\n\t"
+	"entert4:\n\t"
+		"lpm	r17,Z\n\t"					//1
+		"out	%[port],r17\n\t"
+		"LD		r19,X+\n\t"					//2
+		"lsl	r17\n\t"
+		"out	%[port],r17\n\t"
+		"mul	r19,%[eight]\n\t"			//3
+		"lsl	r17\n\t"
+		"out	%[port],r17\n\t"
+		"add	r0,%A[glyph]\n\t"			//4
+		"adc	r1,%B[glyph]\n\t"
+		"lsl	r17\n\t"
+		"out	%[port],r17\n\t"
+		"movw	r30,r0\n\t"					//5
+		"clr	__zero_reg__\n\t"
+		"lsl	r17\n\t"
+		"out	%[port],r17\n\t"
 		"delay2\n\t"						//6
-		"lsl	__tmp_reg__\n\t"
-		"out	%[port],__tmp_reg__\n\t"
+		"lsl	r17\n\t"
+		"out	%[port],r17\n\t"
 		"delay1\n\t"						//7
-		"lsl	__tmp_reg__\n\t"
+		"lsl	r17\n\t"
 		"dec	%[hres]\n\t"
-		"out	%[port],__tmp_reg__\n\t"
-		"brne	loop4\n\t"					//go too loop4
+		"out	%[port],r17\n\t"
+		"brne	loopt4\n\t"
 		"delay1\n\t"						//8
-		"lsl	__tmp_reg__\n\t"
-		"out	%[port],__tmp_reg__\n\t"
+		"lsl	r17\n\t"
+		"out	%[port],r17\n\t"
 		"delay3\n\t"
 		"cbi	%[port],7\n\t"
-		:
+		: "+x" (src),
+		[hres] "+d" (hres)
 		: [port] "i" (_SFR_IO_ADDR(PORT_VID)),
-		"x" (display.screen),
-		"y" (renderLine),
-		[hres] "d" (display.hres)
-		: "r16" // try to remove this clobber later...
+		[glyph] "r" (display.glyph),
+		[eight] "r" ((uint8_t)8)
+		: "r17", "r19", "r30", "r31"
 	);
-	#endif
 }
 
-// only 16mhz right now!!!
+/* Unrolled to _HRES_MAX bytes for the clock, a line of hres bytes jumps in
+ * hres bytes before the end. The entry takes the same 9 cycles for any hres.
+ * No room for anything but the pixels, so no inverting.
+ */
 void render_line3c() {
 	#ifndef REMOVE3C
 	__asm__ __volatile__ (
 	".macro byteshift\n\t"
 		"LD		__tmp_reg__,X+\n\t"
 		"out	%[port],__tmp_reg__\n\t"	//0
+		".rept	7\n\t"
 		"nop\n\t"
 		"lsl	__tmp_reg__\n\t"
-		"out	%[port],__tmp_reg__\n\t"	//1
-		"nop\n\t"
-		"lsl	__tmp_reg__\n\t"
-		"out	%[port],__tmp_reg__\n\t"	//2
-		"nop\n\t"
-		"lsl	__tmp_reg__\n\t"
-		"out	%[port],__tmp_reg__\n\t"	//3
-		"nop\n\t"
-		"lsl	__tmp_reg__\n\t"
-		"out	%[port],__tmp_reg__\n\t"	//4
-		"nop\n\t"
-		"lsl	__tmp_reg__\n\t"
-		"out	%[port],__tmp_reg__\n\t"	//5
-		"nop\n\t"
-		"lsl	__tmp_reg__\n\t"
-		"out	%[port],__tmp_reg__\n\t"	//6
-		"nop\n\t"
-		"lsl	__tmp_reg__\n\t"
-		"out	%[port],__tmp_reg__\n\t"	//7
+		"out	%[port],__tmp_reg__\n\t"	//1-7
+		".endr\n"
 	".endm\n\t"
 	
-		"ADD	r26,r28\n\t"
-		"ADC	r27,r29\n\t"
-		
-		"cpi	%[hres],30\n\t"		//615
-		"breq	skip0\n\t"
-		"cpi	%[hres],29\n\t"
-		"breq	jumpto1\n\t"
-		"cpi	%[hres],28\n\t"
-		"breq	jumpto2\n\t"
-		"cpi	%[hres],27\n\t"
-		"breq	jumpto3\n\t"
-		"cpi	%[hres],26\n\t"
-		"breq	jumpto4\n\t"
-		"cpi	%[hres],25\n\t"
-		"breq	jumpto5\n\t"
-		"cpi	%[hres],24\n\t"
-		"breq	jumpto6\n\t"
-	"jumpto1:\n\t"
-		"rjmp	skip1\n\t"
-	"jumpto2:\n\t"
-		"rjmp	skip2\n\t"
-	"jumpto3:\n\t"
-		"rjmp	skip3\n\t"
-	"jumpto4:\n\t"
-		"rjmp	skip4\n\t"
-	"jumpto5:\n\t"
-		"rjmp	skip5\n\t"
-	"jumpto6:\n\t"
-		"rjmp	skip6\n\t"
-	"skip0:\n\t"
-		"byteshift\n\t"	//1		\\643
-	"skip1:\n\t"
-		"byteshift\n\t"	//2
-	"skip2:\n\t"
-		"byteshift\n\t"	//3
-	"skip3:\n\t"
-		"byteshift\n\t"	//4
-	"skip4:\n\t"
-		"byteshift\n\t"	//5
-	"skip5:\n\t"
-		"byteshift\n\t"	//6
-	"skip6:\n\t"
-		"byteshift\n\t"	//7
-		"byteshift\n\t"	//8
-		"byteshift\n\t"	//9
-		"byteshift\n\t"	//10
-		"byteshift\n\t"	//11
-		"byteshift\n\t"	//12
-		"byteshift\n\t"	//13
-		"byteshift\n\t"	//14
-		"byteshift\n\t"	//15
-		"byteshift\n\t"	//16
-		"byteshift\n\t"	//17
-		"byteshift\n\t"	//18
-		"byteshift\n\t"	//19
-		"byteshift\n\t"	//20
-		"byteshift\n\t"	//21
-		"byteshift\n\t"	//22
-		"byteshift\n\t"	//23
-		"byteshift\n\t"	//24
-		"byteshift\n\t"	//25
-		"byteshift\n\t"	//26
-		"byteshift\n\t"	//27
-		"byteshift\n\t"	//28
-		"byteshift\n\t"	//29
-		"byteshift\n\t"	//30
-		
+		"ldi	r30,pm_lo8(1f)\n\t"
+		"ldi	r31,pm_hi8(1f)\n\t"
+		"mul	%[hres],%[size]\n\t"
+		"sub	r30,r0\n\t"
+		"sbc	r31,r1\n\t"
+		"clr	__zero_reg__\n\t"
+		"ijmp\n\t"
+		".rept	%[bytes]\n\t"
+		"byteshift\n\t"
+		".endr\n"
+	"1:\n\t"
 		"delay2\n\t"
 		"cbi	%[port],7\n\t"
 		:
 		: [port] "i" (_SFR_IO_ADDR(PORT_VID)),
-		"x" (display.screen),
-		"y" (renderLine),
-		[hres] "d" (display.hres)
-		: "r16" // try to remove this clobber later...
+		"x" (display.line_src),
+		[hres] "r" (display.hres),
+		[size] "r" ((uint8_t)23),	//words in a byteshift
+		[bytes] "i" (_HRES_MAX)
+		: "r30", "r31"
 	);
 	#endif
 }
+
+#if defined(UDR_VID)
+/* The usart data register is double buffered, so the next byte only has to
+ * be in before the current one is shifted out. Polling UDRE is enough to keep
+ * the pixels back to back without counting cycles, and the kernel returns
+ * while the last two bytes are still shifting (16 pixels of time, 32-96
+ * cycles). Clearing TXEN only takes effect once they are out, then TXD falls
+ * back to its low port value for the blanking.
+ * ~11 cycles per byte, the rest of a byte's time is spent polling, a
+ * byte every 16 cycles at 2 cycle pixels is too fast for an interrupt per
+ * byte.
+ */
+void render_line_usart() {
+	__asm__ __volatile__ (
+		"sts	%[ucsrb],%[txen]\n\t"
+		"LD		__tmp_reg__,X+\n\t"
+		"eor	__tmp_reg__,%[inv]\n\t"
+		"sts	%[udr],__tmp_reg__\n"
+	"loopu:\n\t"
+		"dec	%[hres]\n\t"
+		"breq	doneu\n\t"
+		"LD		__tmp_reg__,X+\n\t"
+		"eor	__tmp_reg__,%[inv]\n"
+	"waitu:\n\t"
+		"lds	r16,%[ucsra]\n\t"
+		"sbrs	r16,%[udre]\n\t"
+		"rjmp	waitu\n\t"
+		"sts	%[udr],__tmp_reg__\n\t"
+		"rjmp	loopu\n"
+	"doneu:\n\t"
+		"sts	%[ucsrb],__zero_reg__\n\t"
+		:
+		: [udr] "n" (_SFR_MEM_ADDR(UDR_VID)),
+		[ucsra] "n" (_SFR_MEM_ADDR(UCSRA_VID)),
+		[ucsrb] "n" (_SFR_MEM_ADDR(UCSRB_VID)),
+		[udre] "I" (UDRE_VID),
+		[txen] "r" ((uint8_t)_BV(TXEN_VID)),
+		"x" (display.line_src),
+		[inv] "r" (display.line_inv),
+		[hres] "d" (display.hres)
+		: "r16"
+	);
+}
+#endif
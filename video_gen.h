@@ -26,8 +26,83 @@
 #ifndef VIDEO_GEN_H
 #define VIDEO_GEN_H
 
+//ENABLE_CPU_STATS samples TCNT1 in the line interrupt and keeps per frame
+//totals, see TVout::cpu_stats(). Costs ~40 cycles per dispatched line and
+//compiles to nothing when left commented out.
+//#define ENABLE_CPU_STATS
+
+// line schedules, see TVout::set_schedule()
+#define SCHEDULE_EVENT			0
+#define SCHEDULE_LINE			1
+
+// frame schedule actions
+#define EVENT_FRAME				0x01	//start of a new frame
+#define EVENT_RENDER_ON			0x02	//first active line
+#define EVENT_RENDER_OFF		0x04	//first line after active video
+#define EVENT_VBI				0x08	//run vbi_hook
+#define EVENT_WRAP				0x10	//last line of the frame
+#define EVENT_HALF_EVEN			0x20	//half a line long on even fields
+#define EVENT_HALF_ODD			0x40	//half a line long on odd fields
+
+// or'd into the begin() mode, see TVout::begin()
+#define _INTERLACED				2
+
+#define MAX_EVENTS				8
+#define MAX_TASKS				4
+#define MAX_SPRITES				4
+#define MAX_SPRITES_LINE		2	//see TVout::set_sprite()
+
+// sprite modes
+#define SPRITE_OFF				0
+#define SPRITE_OR				1
+#define SPRITE_XOR				2
+
+typedef struct {
+	int line;
+	uint16_t ocr1a;			//0 leaves OCR1A alone
+	uint16_t icr1;			//0 leaves ICR1 alone
+	uint8_t action;
+} TVout_event;
+
+// display list attributes, see TVout::set_display_list()
+#define LINE_INVERT				0x01	//swap black and white, not at 3c
+#define LINE_BLANK				0x02	//output nothing
+#define LINE_REPEAT				0x04	//same source and attributes as the row above
+
+typedef struct {
+	uint8_t * src;
+	uint8_t attr;
+} TVout_line;
+
+typedef struct {
+	uint8_t rows;			//screen rows in the zone
+	uint8_t vscale;			//lines per row
+} TVout_zone;
+
+typedef struct {
+	const unsigned char * image;	//8 pixels wide, bitmap() format
+	uint8_t x;
+	uint8_t y;
+	uint8_t h;
+	uint8_t mode;
+} TVout_sprite;
+
+typedef struct {
+	void (*func)();
+	unsigned int cycles;	//worst case run time
+} TVout_task;
+
 typedef struct {
 	volatile int scanLine;
+	int next_event;			//line of the next frame_events entry
+	volatile uint8_t skip;	//lines the line interrupt can just count
+	uint8_t event;			//index of the next frame_events entry
+	uint8_t render;
+	uint8_t schedule;
+	volatile uint8_t sleep_sync;	//sleep until OCR1B before active lines
+	uint8_t jitter;			//spread of the active line entry time last frame
+	uint8_t entry_min;
+	uint8_t entry_max;
 	volatile unsigned long frames;
 	unsigned char start_render;
 	int lines_frame;	  	//remove me
@@ -38,27 +113,88 @@ typedef struct {
 	char vscale;			//combine me too.
 	char vsync_end;			//remove me
 	uint8_t * screen;
+	uint8_t origin;			//screen row shown at the top
+	uint8_t * back;			//back buffer, NULL when single buffered
+	uint8_t * draw;			//buffer the drawing functions use
+	uint8_t draw_origin;	//origin of draw
+	volatile uint8_t flip;	//swap screen and back at the end of the active area
+	uint8_t * empty;		//bit per screen row set when it is all black
+	uint8_t * draw_empty;	//same for draw
+	uint8_t skip_empty;		//don't render empty rows
+	uint8_t interlace;		//even rows on one field, odd on the next
+	volatile uint8_t field;	//parity of the rows this field shows
+	TVout_zone * zones;		//NULL for vscale_const everywhere
+	uint8_t zone_count;
+	TVout_line * list;		//NULL renders screen
+	uint8_t * line_src;		//source of the row being rendered
+	uint8_t line_inv;		//0xff to invert it
+	uint8_t line_delay;		//output start of the row being rendered
+	uint8_t cpp;			//cycles per pixel of render_line
+	uint8_t hscroll;		//pixels to scroll left
+	uint8_t * hscroll_table;	//hscroll per row, NULL uses hscroll
+	const unsigned char * font;	//glyph 0 of the text mode font, NULL for bitmap
+	const unsigned char * glyph;	//font + glyph row of the row being rendered
+	uint8_t * attr;			//text mode attributes, NULL for none
+	uint8_t * attr_src;		//attributes of the row being rendered
+	uint8_t sprites;		//sprites not SPRITE_OFF
+	unsigned int sprite_drops;	//rows that dropped sprites this frame
+	unsigned int sprite_overflow;	//and last frame
+	uint8_t line_attr;
 } TVout_vid;
 
 extern TVout_vid display;
 
+#if defined(ENABLE_CPU_STATS)
+typedef struct {
+	unsigned long frame_cycles;		//cycles in a frame
+	unsigned long isr_cycles;		//in the line interrupt, everything below included
+	unsigned long active_cycles;	//on active lines
+	unsigned long blank_cycles;		//on dispatched lines that did not render
+	unsigned long hook_cycles;		//in hbi_hook and vbi_hook
+	unsigned int idle_lines;		//lines only counted by the interrupt entry
+	unsigned int worst_line;		//longest line interrupt in cycles
+	unsigned int late_lines;		//line interrupts that ran into the next line
+	unsigned int missed_frames;		//frames with late lines since render_setup()
+} TVout_stats;
+
+extern TVout_stats frame_stats;
+#endif
+extern TVout_event frame_events[MAX_EVENTS];
+
 extern void (*hbi_hook)();
 extern void (*vbi_hook)();
+extern TVout_task tasks[MAX_TASKS];
+extern TVout_sprite sprites[MAX_SPRITES];
+extern uint8_t task_count;
 
 void render_setup(uint8_t mode, uint8_t x, uint8_t y, uint8_t *scrnptr);
+void render_start(uint8_t mode, uint8_t x, uint8_t y, uint8_t *scrnptr, void (*line)(), uint8_t cpp);
+void schedule_setup();
+int render_lines();
 
-void blank_line();
+void line_dispatch() __asm__("__vector_line_dispatch") __attribute__((signal, used));
 void active_line();
-void vsync_line();
 void empty();
 
 //tone generation properties
 extern volatile long remainingToneVsyncs;
 
 // 6cycles functions
+void render_line_w32();
+void render_line_w48();
+void render_line_w64();
+void render_line_w80();
+void render_line16c();
+void render_line12c();
+void render_line10c();
+void render_line8c();
+void render_line7c();
 void render_line6c();
 void render_line5c();
 void render_line4c();
 void render_line3c();
+void render_line_usart();
+void render_line_text6c();
+void render_line_text4c();
 static void inline wait_until(uint8_t time);
 #endif